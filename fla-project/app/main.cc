@@ -4,13 +4,20 @@
  * @brief The main file for the fla program.
  */
 
+#include <fla/batch.h>
 #include <fla/pda.h>
 #include <fla/simulator.h>
+#include <fla/source.h>
 #include <fla/tm.h>
+#include <fla/trace.h>
 
+#include <algorithm>
+#include <chrono>
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -18,6 +25,143 @@ void print_usage() {
     std::cerr << "Usage:\tfla [-h|--help]\n";
     std::cerr << "      \tfla [-v|--verbose] <pda> <input>\n";
     std::cerr << "      \tfla [-v|--verbose] <tm> <input>\n";
+    std::cerr << "      \tfla [-v|--verbose] -b|--batch [-j|--jobs <n>] <pda|tm> [<inputs>]\n";
+    std::cerr << "      \tfla [-v|--verbose] <pda> -i|--input-file <file|->\n";
+    std::cerr << "      \tfla compile <pda|tm> [-o|--output <image>]\n";
+    std::cerr << "      \tfla codegen <tm> [-o|--output <source>]\n";
+    std::cerr << "      \tfla trace-render <trace> [-o|--output <file>]\n";
+    std::cerr << "Options:\n";
+    std::cerr << "      \t-n|--nondeterministic\tfollow every applicable transition\n";
+    std::cerr << "      \t--max-configs <n>\tconfigurations a non-deterministic run may visit, "
+                 "0 for no limit\n";
+    std::cerr << "      \t--search <bfs|dfs|iddfs>\tsearch order of a non-deterministic tm\n";
+    std::cerr << "      \t--max-steps <n>\tsteps a run may take, 0 for no limit\n";
+    std::cerr << "      \t--max-cells <n>\ttape or stack cells a run may use, 0 for no limit\n";
+    std::cerr << "      \t--timeout <ms>\twall-clock time a run may take, 0 for no limit\n";
+    std::cerr << "      \t--detect-loops\tstop a run that repeats a configuration\n";
+    std::cerr << "      \t--table-limit <bytes>\tmemory for each compiled tm transition table, "
+                 "0 to disable them\n";
+    std::cerr << "      \t--tape <flat|rle>\ttape storage of a deterministic tm\n";
+    std::cerr << "      \t--macro <width>\tcache sweeps over blocks of a single-tape tm, "
+                 "0 to disable it\n";
+    std::cerr << "      \t--check-overlaps\treport the rules of a tm that overlap earlier ones\n";
+    std::cerr << "      \t--trace <file>\trecord deterministic runs for fla trace-render\n";
+    std::cerr << "      \t--show-from <step>\tfirst step -v prints\n";
+    std::cerr << "      \t--show-to <step>\tlast step -v prints, 0 for no limit\n";
+    std::cerr << "      \t--show-every <k>\tprint every k-th step with -v\n";
+    std::cerr << "      \t--show-states <q1,q2,...>\tprint steps entering these states with -v\n";
+    std::cerr << "      \t--show-last <n>\tprint the last n steps with -v when the run halts\n";
+    std::cerr << "      \t--stats <text|json>\tprint the steps, times and cells of the run "
+                 "to stderr\n";
+    std::cerr << "      \t--profile\tadd how often each rule fired and each state was met, "
+                 "counted over the explored branches with -n\n";
+}
+
+// The line printed for a finished run
+std::string format_result(const fla::Result &result) {
+    if (result.reason == fla::HaltReason::Limit)
+        return "limit";
+    if (result.reason == fla::HaltReason::Timeout)
+        return "timeout";
+    if (result.reason == fla::HaltReason::Loop)
+        return "loop";
+    return result.output;
+}
+
+// `value` as a JSON string
+std::string json_string(const std::string &value) {
+    std::string quoted = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+    return quoted + '"';
+}
+
+// Ids of `counts` from the highest count down, ties in order
+std::vector<size_t> hottest(const std::vector<uint64_t> &counts) {
+    std::vector<size_t> ids(counts.size());
+    for (size_t i = 0; i < ids.size(); ++i)
+        ids[i] = i;
+    std::stable_sort(ids.begin(), ids.end(),
+                     [&counts](size_t a, size_t b) { return counts[a] > counts[b]; });
+    return ids;
+}
+
+// Prints the stats of a run that took `parse` and `run` seconds to parse and to run, as
+// "text" or "json". The stack depth is printed for a pda, the tape cells for a tm.
+void print_stats(std::ostream &out, const std::string &format, bool pda,
+                 const fla::Result &result, const fla::RunStats &stats, double parse,
+                 double run) {
+    double speed = run > 0 ? static_cast<double>(result.steps) / run : 0;
+    std::vector<size_t> states = hottest(stats.visits);
+    std::vector<size_t> rules = hottest(stats.fires);
+
+    if (format == "json") {
+        out << "{\"steps\": " << result.steps << ", \"parse_seconds\": " << parse
+            << ", \"run_seconds\": " << run << ", \"steps_per_second\": " << speed;
+        if (pda) {
+            out << ", \"max_stack\": " << stats.max_stack;
+        } else {
+            out << ", \"tape_cells\": [";
+            for (size_t i = 0; i < stats.tape_cells.size(); ++i)
+                out << (i == 0 ? "" : ", ") << stats.tape_cells[i];
+            out << "]";
+        }
+        out << ", \"states\": [";
+        for (size_t i = 0; i < states.size(); ++i)
+            out << (i == 0 ? "" : ", ") << "{\"state\": " << json_string(stats.states[states[i]])
+                << ", \"visits\": " << stats.visits[states[i]] << "}";
+        out << "], \"rules\": [";
+        for (size_t i = 0; i < rules.size(); ++i)
+            out << (i == 0 ? "" : ", ") << "{\"rule\": " << json_string(stats.rules[rules[i]])
+                << ", \"fires\": " << stats.fires[rules[i]] << "}";
+        out << "]}" << std::endl;
+        return;
+    }
+
+    out << "steps: " << result.steps << '\n';
+    out << "parse time: " << parse << " s\n";
+    out << "run time: " << run << " s\n";
+    out << "steps per second: " << speed << '\n';
+    if (pda)
+        out << "max stack: " << stats.max_stack << '\n';
+    for (size_t i = 0; i < stats.tape_cells.size(); ++i)
+        out << "tape " << i << " cells: " << stats.tape_cells[i] << '\n';
+    if (!states.empty())
+        out << "state visits:\n";
+    for (size_t id : states)
+        out << "  " << stats.visits[id] << '\t' << stats.states[id] << '\n';
+    if (!rules.empty())
+        out << "rule fires:\n";
+    for (size_t id : rules)
+        out << "  " << stats.fires[id] << '\t' << stats.rules[id] << '\n';
+    out.flush();
+}
+
+// Streams every line of `in` through the runner and prints one result per line
+int run_batch(fla::BatchRunner &runner, std::istream &in, bool verbose) {
+    int status = EXIT_SUCCESS;
+    auto next = [&in](std::string &input) {
+        if (!std::getline(in, input))
+            return false;
+        if (!input.empty() && input.back() == '\r')
+            input.pop_back();
+        return true;
+    };
+    runner.run(next, [&status, verbose](const fla::BatchResult &result) {
+        if (result.error != fla::Error::None)
+            status = EXIT_FAILURE;
+        if (verbose)
+            return;
+        if (result.error != fla::Error::None)
+            std::cout << "illegal input" << '\n';
+        else
+            std::cout << format_result(result.result) << '\n';
+    });
+    std::cout.flush();
+    return status;
 }
 
 int main(int argc, const char *argv[]) {
@@ -28,12 +172,98 @@ int main(int argc, const char *argv[]) {
         {"--help", false},
         {"-v", false},
         {"--verbose", false},
+        {"-b", false},
+        {"--batch", false},
+        {"-n", false},
+        {"--nondeterministic", false},
+        {"--detect-loops", false},
+        {"--check-overlaps", false},
+        {"--profile", false},
+    };
+
+    size_t jobs = 1; // 0 means one job per hardware thread
+    size_t max_configurations = 1000000;
+    size_t max_steps = 0;
+    size_t max_cells = 0;
+    size_t timeout = 0; // in milliseconds
+    size_t table_limit = 16 << 20;
+    size_t macro_block = 0;
+    fla::TraceFilter filter{};
+    std::map<std::string, size_t *> counts = {
+        {"-j", &jobs},
+        {"--jobs", &jobs},
+        {"--max-configs", &max_configurations},
+        {"--max-steps", &max_steps},
+        {"--max-cells", &max_cells},
+        {"--timeout", &timeout},
+        {"--table-limit", &table_limit},
+        {"--macro", &macro_block},
+        {"--show-from", &filter.first},
+        {"--show-to", &filter.last},
+        {"--show-every", &filter.every},
+        {"--show-last", &filter.ring},
+    };
+
+    std::map<std::string, fla::SearchStrategy> strategies = {
+        {"bfs", fla::SearchStrategy::BreadthFirst},
+        {"dfs", fla::SearchStrategy::DepthFirst},
+        {"iddfs", fla::SearchStrategy::IterativeDeepening},
+    };
+    std::string search = "bfs";
+    std::map<std::string, fla::TapeBackend> backends = {
+        {"flat", fla::TapeBackend::Flat},
+        {"rle", fla::TapeBackend::RunLength},
+    };
+    std::string tape = "flat";
+    std::string output{};
+    std::string input_file{}; // "-" for the standard input
+    std::string trace_file{};
+    std::string show_states{}; // comma separated
+    std::string stats{};
+    std::map<std::string, std::string *> values = {
+        {"--search", &search},
+        {"--tape", &tape},
+        {"-o", &output},
+        {"--output", &output},
+        {"-i", &input_file},
+        {"--input-file", &input_file},
+        {"--trace", &trace_file},
+        {"--show-states", &show_states},
+        {"--stats", &stats},
     };
 
     std::vector<std::string> args;
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
-        if (arg[0] == '-') { // Check if arg is an option
+        if (counts.find(arg) != counts.end()) { // Check if arg is an option with a count
+            try {
+                if (i + 1 == argc || argv[i + 1][0] == '-')
+                    throw std::invalid_argument(arg);
+                std::string value = argv[++i];
+                size_t end = 0;
+                *counts[arg] = std::stoul(value, &end);
+                if (end != value.size())
+                    throw std::invalid_argument(value);
+            } catch (const std::logic_error &) {
+                std::cerr << "Invalid value for option: " << arg << std::endl;
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        } else if (values.find(arg) != values.end()) { // Check if arg is an option with a value
+            // A lone "-" names the standard input
+            std::string next = i + 1 < argc ? argv[i + 1] : "";
+            bool valid = !next.empty() &&
+                         (next[0] != '-' || (values[arg] == &input_file && next == "-"));
+            if (valid)
+                *values[arg] = argv[++i];
+            if (!valid || (arg == "--search" && strategies.find(search) == strategies.end()) ||
+                (arg == "--tape" && backends.find(tape) == backends.end()) ||
+                (arg == "--stats" && stats != "text" && stats != "json")) {
+                std::cerr << "Invalid value for option: " << arg << std::endl;
+                print_usage();
+                return EXIT_FAILURE;
+            }
+        } else if (arg[0] == '-') { // Check if arg is an option
             if (options.find(arg) != options.end()) {
                 options[arg] = true;
             } else {
@@ -51,13 +281,44 @@ int main(int argc, const char *argv[]) {
         return EXIT_SUCCESS;
     }
 
-    if (args.size() != 2) {
+    bool compile = !args.empty() && args[0] == "compile";
+    bool codegen = !args.empty() && args[0] == "codegen";
+    bool render = !args.empty() && args[0] == "trace-render";
+    if (compile || codegen || render)
+        args.erase(args.begin());
+
+    // The runs of a batch would write into the trace at once and share no stats
+    bool batch = options["-b"] || options["--batch"];
+    if (options["--profile"] && stats.empty())
+        stats = "text";
+    bool stream = !input_file.empty();
+    bool arguments = compile || codegen || render || stream ? args.size() == 1
+                     : batch ? !args.empty() && args.size() <= 2 : args.size() == 2;
+    if (!arguments || (batch && (!trace_file.empty() || !stats.empty()))) {
         print_usage();
         return EXIT_FAILURE;
     }
 
+    if (render) {
+        std::ofstream fout{};
+        if (!output.empty()) {
+            fout.open(output);
+            if (!fout.is_open()) {
+                std::cerr << "Could not open the file: " << output << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        std::ostream &out = output.empty() ? std::cout : fout;
+        bool valid = fla::render_trace(args[0], out);
+        out.flush();
+        if (!valid) {
+            std::cerr << "Invalid trace: " << args[0] << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
     std::string filepath = args[0];
-    std::string input = args[1];
 
     size_t dot_pos = filepath.rfind(".");
     std::string extension{};
@@ -65,21 +326,127 @@ int main(int argc, const char *argv[]) {
         extension = filepath.substr(dot_pos + 1);
     }
 
+    // Images written by `fla compile` end in 'c'
+    bool image = extension == "pdac" || extension == "tmc";
+    if (image)
+        extension.pop_back();
+
     std::unique_ptr<fla::Simulator> simulator{};
+    fla::TMSimulator *tm_simulator = nullptr;
+    fla::PDASimulator *pda_simulator = nullptr;
     if (extension == "pda") {
-        simulator = std::make_unique<fla::PDASimulator>();
+        auto pda = std::make_unique<fla::PDASimulator>();
+        pda_simulator = pda.get();
+        simulator = std::move(pda);
     } else if (extension == "tm") {
-        simulator = std::make_unique<fla::TMSimulator>();
+        auto tm = std::make_unique<fla::TMSimulator>();
+        tm->set_search_strategy(strategies[search]);
+        tm->set_table_limit(table_limit);
+        tm->set_macro_block(macro_block);
+        tm->set_tape_backend(backends[tape]);
+        tm->set_check_overlaps(options["--check-overlaps"]);
+        tm_simulator = tm.get();
+        simulator = std::move(tm);
     } else {
         std::cerr << "Unknown file type: " << filepath << std::endl;
         std::cerr << "The file format must be '*.pda' or '*.tm'" << std::endl;
         return EXIT_FAILURE;
     }
 
+    if (codegen && !tm_simulator) {
+        std::cerr << "Only '*.tm' files can be generated: " << filepath << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (stream && !pda_simulator) {
+        std::cerr << "Only '*.pda' files can stream their input: " << filepath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::shared_ptr<fla::TraceWriter> trace{};
+    if (!trace_file.empty()) {
+        trace = std::make_shared<fla::TraceWriter>(trace_file);
+        if (!trace->is_open()) {
+            std::cerr << "Could not open the file: " << trace_file << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    bool verbose = options["-v"] || options["--verbose"];
     try {
-        simulator->set_verbose(options["-v"] || options["--verbose"]);
-        simulator->parse(filepath);
-        simulator->run(input);
+        simulator->set_verbose(verbose);
+        simulator->set_nondeterministic(options["-n"] || options["--nondeterministic"]);
+        simulator->set_max_configurations(max_configurations);
+        simulator->set_max_steps(max_steps);
+        simulator->set_max_cells(max_cells);
+        simulator->set_detect_cycles(options["--detect-loops"]);
+        simulator->set_timeout(std::chrono::milliseconds(timeout));
+        simulator->set_trace(trace);
+        std::istringstream states(show_states);
+        for (std::string state; std::getline(states, state, ',');)
+            filter.states.push_back(state);
+        simulator->set_trace_filter(filter);
+        simulator->set_profile(options["--profile"]);
+        auto start = std::chrono::steady_clock::now();
+        if (image)
+            simulator->load(filepath);
+        else
+            simulator->parse(filepath);
+        std::chrono::duration<double> parse_time = std::chrono::steady_clock::now() - start;
+
+        if (compile) {
+            simulator->save(output.empty() ? filepath + "c" : output);
+            return EXIT_SUCCESS;
+        }
+
+        if (codegen) { // machine.tm -> machine_sim.cc
+            tm_simulator->codegen(output.empty() ? filepath.substr(0, dot_pos) + "_sim.cc"
+                                                 : output);
+            return EXIT_SUCCESS;
+        }
+
+        if (batch) {
+            // The traces of parallel runs would interleave
+            fla::BatchRunner runner(*simulator, verbose ? 1 : jobs);
+            if (args.size() == 1) // inputs are streamed on stdin
+                return run_batch(runner, std::cin, verbose);
+
+            std::ifstream fin(args[1]);
+            if (!fin.is_open()) {
+                std::cerr << "Could not open the file: " << args[1] << std::endl;
+                return EXIT_FAILURE;
+            }
+            return run_batch(runner, fin, verbose);
+        }
+
+        fla::Result result{};
+        start = std::chrono::steady_clock::now();
+        if (stream && input_file == "-") {
+            fla::InputCursor input(std::cin, true);
+            result = pda_simulator->run(input);
+        } else if (stream) { // mapped where the platform allows it
+            fla::SourceFile source(input_file);
+            if (!source.is_open()) {
+                std::cerr << "Could not open the file: " << input_file << std::endl;
+                return EXIT_FAILURE;
+            }
+            fla::InputCursor input(source.data(), source.size(), true);
+            result = pda_simulator->run(input);
+        } else {
+            result = simulator->run(args[1]);
+        }
+        std::chrono::duration<double> run_time = std::chrono::steady_clock::now() - start;
+        if (trace) {
+            trace->flush();
+            if (!trace->good()) {
+                std::cerr << "Could not write the file: " << trace_file << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if (!verbose)
+            std::cout << format_result(result) << std::endl;
+        if (!stats.empty())
+            print_stats(std::cerr, stats, pda_simulator != nullptr, result, simulator->stats(),
+                        parse_time.count(), run_time.count());
     } catch (const fla::Error &e) {
         return EXIT_FAILURE;
     }
@@ -0,0 +1,26 @@
+/**
+ * @file bench/bench.h
+ * @brief Workloads of the benchmark suite.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// A timed workload. prepare() does the untimed setup for `size` items and returns the timed
+// part, which returns the number of items it processed.
+struct Benchmark {
+    std::string name;
+    size_t size; // items at scale 1
+    std::function<std::function<size_t()>(size_t size)> prepare;
+};
+
+// Every workload, generated machines are written to `dir` and removed by cleanup()
+std::vector<Benchmark> benchmarks(const std::string &dir);
+void cleanup();
+
+} // namespace bench
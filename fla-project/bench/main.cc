@@ -0,0 +1,183 @@
+/**
+ * @file bench/main.cc
+ * @brief Runs the benchmark suite and compares it with a JSON baseline.
+ */
+
+#include "bench.h"
+
+#include <fla/simulator.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace {
+
+struct Measurement {
+    std::string name;
+    size_t items;
+    double ms;          // best wall-clock time of the repeats
+    double ns_per_item; // compared with the baseline
+};
+
+void print_usage() {
+    std::cerr << "Usage:\tfla-bench [--scale <x>] [--repeats <n>] [--filter <name>] "
+                 "[--json <file>] [--baseline <file>] [--tolerance <percent>]\n";
+}
+
+// Best of `repeats` runs of the workload
+Measurement measure(const bench::Benchmark &benchmark, double scale, int repeats) {
+    size_t size = static_cast<size_t>(static_cast<double>(benchmark.size) * scale);
+    std::function<size_t()> workload = benchmark.prepare(size == 0 ? 1 : size);
+
+    Measurement best{benchmark.name, 0, 0, 0};
+    for (int i = 0; i < repeats; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        size_t items = workload();
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - begin;
+        if (i == 0 || elapsed.count() < best.ms) {
+            best.items = items;
+            best.ms = elapsed.count();
+        }
+    }
+    best.ns_per_item = best.items == 0 ? 0 : best.ms * 1e6 / static_cast<double>(best.items);
+    return best;
+}
+
+// The scale and the ns_per_item of each benchmark of a file written with --json, which has
+// one benchmark per line
+bool read_baseline(const std::string &path, double &scale,
+                   std::map<std::string, double> &baseline) {
+    std::ifstream in(path);
+    if (!in.is_open())
+        return false;
+    for (std::string line; std::getline(in, line);) {
+        size_t key = line.find("\"scale\": ");
+        if (key != std::string::npos)
+            scale = std::strtod(line.c_str() + key + 9, nullptr);
+
+        size_t name = line.find("\"name\": \"");
+        size_t speed = line.find("\"ns_per_item\": ");
+        if (name == std::string::npos || speed == std::string::npos)
+            continue;
+        name += 9;
+        baseline[line.substr(name, line.find('"', name) - name)] =
+            std::strtod(line.c_str() + speed + 15, nullptr);
+    }
+    return true;
+}
+
+void write_json(std::ostream &out, double scale, const std::vector<Measurement> &results) {
+    out << "{\n  \"scale\": " << scale << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Measurement &result = results[i];
+        out << "    {\"name\": \"" << result.name << "\", \"items\": " << result.items
+            << ", \"ms\": " << result.ms << ", \"ns_per_item\": " << result.ns_per_item << "}"
+            << (i + 1 == results.size() ? "\n" : ",\n");
+    }
+    out << "  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+    std::clog.setstate(std::ios_base::failbit);
+
+    double scale = 1;
+    int repeats = 5;
+    double tolerance = 20; // percent, short workloads vary by about as much between runs
+    std::string filter{};
+    std::string json{};
+    std::string baseline_path{};
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+        std::string value = argv[++i];
+        if (arg == "--scale")
+            scale = std::strtod(value.c_str(), nullptr);
+        else if (arg == "--repeats")
+            repeats = std::atoi(value.c_str());
+        else if (arg == "--tolerance")
+            tolerance = std::strtod(value.c_str(), nullptr);
+        else if (arg == "--filter")
+            filter = value;
+        else if (arg == "--json")
+            json = value;
+        else if (arg == "--baseline")
+            baseline_path = value;
+        else {
+            print_usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (scale <= 0 || repeats <= 0) {
+        print_usage();
+        return EXIT_FAILURE;
+    }
+
+    // Workloads of another scale take another share of their time in setup and caches
+    std::map<std::string, double> baseline{};
+    double baseline_scale = 1;
+    if (!baseline_path.empty() && !read_baseline(baseline_path, baseline_scale, baseline)) {
+        std::cerr << "Could not open the file: " << baseline_path << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!baseline.empty() && std::abs(baseline_scale - scale) > 1e-5 * scale) { // as printed
+        std::cerr << "The baseline was recorded at scale " << baseline_scale << ", not " << scale
+                  << ": " << baseline_path << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const char *tmpdir = std::getenv("TMPDIR");
+    std::vector<Measurement> results{};
+    int status = EXIT_SUCCESS;
+    try {
+        for (const bench::Benchmark &benchmark : bench::benchmarks(tmpdir ? tmpdir : "/tmp")) {
+            if (benchmark.name.find(filter) == std::string::npos)
+                continue;
+            results.push_back(measure(benchmark, scale, repeats));
+            const Measurement &result = results.back();
+
+            std::ostringstream line{};
+            line << std::left << std::setw(26) << result.name << std::right << std::setw(12)
+                 << result.items << " items " << std::fixed << std::setprecision(2)
+                 << std::setw(10) << result.ms << " ms " << std::setw(9) << result.ns_per_item
+                 << " ns/item";
+            auto previous = baseline.find(result.name);
+            if (previous != baseline.end() && previous->second > 0) {
+                double change = (result.ns_per_item / previous->second - 1) * 100;
+                line << std::showpos << std::setw(9) << change << '%' << std::noshowpos;
+                if (change > tolerance) {
+                    line << " regression";
+                    status = EXIT_FAILURE;
+                }
+            }
+            std::cout << line.str() << std::endl;
+        }
+    } catch (const fla::Error &) {
+        std::cerr << "the benchmark machines did not parse" << std::endl;
+        bench::cleanup();
+        return EXIT_FAILURE;
+    }
+    bench::cleanup();
+
+    if (!json.empty()) {
+        std::ofstream out(json);
+        write_json(out, scale, results);
+        if (!out) {
+            std::cerr << "Could not write the file: " << json << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return status;
+}
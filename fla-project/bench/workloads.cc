@@ -0,0 +1,165 @@
+/**
+ * @file bench/workloads.cc
+ * @brief Microbenchmarks and generated machines of the benchmark suite.
+ */
+
+#include "bench.h"
+
+#include <fla/pda.h>
+#include <fla/simulator.h>
+#include <fla/tm.h>
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+
+namespace bench {
+
+namespace {
+
+std::vector<std::string> generated{};
+
+// A single-tape TM with `lines` transitions, five per state over the tape alphabet. From any
+// tape it runs forever, passing through every state.
+std::string generate_tm(const std::string &dir, size_t lines) {
+    const std::string symbols = "abcd_";
+    size_t states = (lines + symbols.size() - 1) / symbols.size();
+
+    std::string path = dir + "/fla-bench-" + std::to_string(lines) + ".tm";
+    std::ofstream out(path);
+    out << "; synthetic machine for the benchmarks\n";
+    out << "#Q = {";
+    for (size_t i = 0; i < states; ++i)
+        out << (i ? "," : "") << 'q' << i;
+    out << "}\n#S = {a,b,c,d}\n#G = {a,b,c,d,_}\n#q0 = q0\n#B = _\n#F = {q0}\n#N = 1\n\n";
+    for (size_t i = 0; i < lines; ++i) {
+        size_t state = i / symbols.size();
+        char symbol = symbols[i % symbols.size()];
+        out << 'q' << state << ' ' << symbol << ' ' << symbols[(i + 1) % symbols.size()] << " r q"
+            << (state + 1) % states << " ; rule " << i << '\n';
+    }
+    generated.push_back(path);
+    return path;
+}
+
+// A PDA with `lines` transitions, six per state over its input and stack alphabets
+std::string generate_pda(const std::string &dir, size_t lines) {
+    const std::string inputs = "ab";
+    const std::string tops = "xyz";
+    size_t per_state = inputs.size() * tops.size();
+    size_t states = (lines + per_state - 1) / per_state;
+
+    std::string path = dir + "/fla-bench-" + std::to_string(lines) + ".pda";
+    std::ofstream out(path);
+    out << "; synthetic machine for the benchmarks\n";
+    out << "#Q = {";
+    for (size_t i = 0; i < states; ++i)
+        out << (i ? "," : "") << 'q' << i;
+    out << "}\n#S = {a,b}\n#G = {x,y,z}\n#q0 = q0\n#z0 = z\n#F = {q0}\n\n";
+    for (size_t i = 0; i < lines; ++i) {
+        size_t state = i / per_state;
+        out << 'q' << state << ' ' << inputs[i % inputs.size()] << ' '
+            << tops[i / inputs.size() % tops.size()] << " q" << (state + 1) % states << " xy\n";
+    }
+    generated.push_back(path);
+    return path;
+}
+
+// Sweeps the head back and forth over 1000 cells, writing as it goes
+std::function<size_t()> tape_step(size_t size) {
+    return [size]() {
+        fla::Tape tape{};
+        tape.init("");
+        const char symbols[] = "abc_";
+        for (size_t i = 0; i < size; ++i)
+            tape.step(symbols[i & 3], (i / 1000) & 1 ? 'l' : 'r');
+        return size + (tape.read() == '\0');
+    };
+}
+
+// Compares read strings with and without wildcards, as the transition lookup does
+std::function<size_t()> symbol_seq_equal(size_t size) {
+    return [size]() {
+        const std::vector<fla::SymbolSeq> seqs = {
+            fla::SymbolSeq("ab_c"), fla::SymbolSeq("a*_c"), fla::SymbolSeq("ab_d"),
+            fla::SymbolSeq("****"), fla::SymbolSeq("_b_c"), fla::SymbolSeq("ab_c"),
+        };
+        size_t equal = 0;
+        for (size_t i = 0; i < size; ++i)
+            equal += seqs[i % seqs.size()] == seqs[i / seqs.size() % seqs.size()];
+        return size + (equal == 0);
+    };
+}
+
+template <typename Simulator>
+std::function<size_t()> parse(const std::string &path, size_t size) {
+    return [path, size]() {
+        Simulator simulator{};
+        simulator.parse(path);
+        return size;
+    };
+}
+
+// Whole runs, which return the steps taken
+template <typename Simulator>
+std::function<size_t()> run(std::shared_ptr<Simulator> simulator, const std::string &input) {
+    return [simulator, input]() { return simulator->run(input).steps; };
+}
+
+} // namespace
+
+std::vector<Benchmark> benchmarks(const std::string &dir) {
+    return {
+        {"tape_step", 10000000, tape_step},
+        {"symbol_seq_equal", 10000000, symbol_seq_equal},
+        {"parse_tm", 50000,
+         [dir](size_t size) {
+             return parse<fla::TMSimulator>(generate_tm(dir, size), size);
+         }},
+        {"parse_pda", 50000,
+         [dir](size_t size) {
+             return parse<fla::PDASimulator>(generate_pda(dir, size), size);
+         }},
+        // a^n b^n, one PDA step per symbol
+        {"run_pda_anbn", 1000000,
+         [](size_t size) {
+             auto pda = std::make_shared<fla::PDASimulator>();
+             pda->parse(FLA_SOURCE_DIR "/pda/anbn.pda");
+             return run(pda, std::string(size, 'a') + std::string(size, 'b'));
+         }},
+        // A palindrome of `size` symbols on the two-tape detector
+        {"run_tm_palindrome", 1000000,
+         [](size_t size) {
+             auto tm = std::make_shared<fla::TMSimulator>();
+             tm->parse(FLA_SOURCE_DIR "/tm/palindrome_detector_2tapes.tm");
+             std::string input(size, '0');
+             for (size_t i = 0; i < size / 2; i += 3)
+                 input[i] = input[size - 1 - i] = '1';
+             return run(tm, input);
+         }},
+        // `size` steps through 50000 rules, with the threaded program and without any table
+        {"run_tm_synthetic", 10000000,
+         [dir](size_t size) {
+             auto tm = std::make_shared<fla::TMSimulator>();
+             tm->parse(generate_tm(dir, 50000));
+             tm->set_max_steps(size);
+             return run(tm, "abcd");
+         }},
+        {"run_tm_synthetic_general", 2000000,
+         [dir](size_t size) {
+             auto tm = std::make_shared<fla::TMSimulator>();
+             tm->set_table_limit(0);
+             tm->parse(generate_tm(dir, 50000));
+             tm->set_max_steps(size);
+             return run(tm, "abcd");
+         }},
+    };
+}
+
+void cleanup() {
+    for (const std::string &path : generated)
+        std::remove(path.c_str());
+    generated.clear();
+}
+
+} // namespace bench
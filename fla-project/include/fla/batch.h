@@ -0,0 +1,71 @@
+#pragma once
+
+#include <fla/simulator.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fla {
+
+struct BatchResult {
+    Error error = Error::None; // the error thrown by Simulator::run, if any
+    Result result{};
+};
+
+// Evaluates many inputs against one parsed machine. Every worker is a thread that owns a
+// clone of the simulator and lives as long as the runner, idle workers steal pending inputs
+// from the busiest ones. A runner of one job runs the inputs on the calling thread.
+class BatchRunner {
+  public:
+    BatchRunner(const Simulator &simulator, size_t jobs);
+    ~BatchRunner(); // stops and joins the workers
+
+    BatchRunner(const BatchRunner &) = delete;
+    BatchRunner &operator=(const BatchRunner &) = delete;
+
+    size_t jobs() const { return _contexts.size(); };
+
+    // Runs every input `next` stores until it returns false, and passes the results to `done`
+    // on the calling thread in the order of the inputs. Inputs are handed out while the
+    // oldest unfinished one is less than a window of inputs behind, so a long run holds back
+    // the output but not the other workers.
+    void run(const std::function<bool(std::string &)> &next,
+             const std::function<void(const BatchResult &)> &done);
+    // Results are returned in the order of the inputs
+    std::vector<BatchResult> run(const std::vector<std::string> &inputs);
+
+  private:
+    struct WorkQueue {
+        std::mutex mutex{};
+        std::deque<size_t> tasks{}; // input numbers
+    };
+    // An input of the window and its result
+    struct Slot {
+        std::string input{};
+        BatchResult result{};
+        std::atomic<bool> ready{false}; // set by the worker, cleared once the result is passed on
+    };
+
+    bool next_task(size_t id, size_t &task); // takes or steals a task for worker `id`
+    void work(size_t id);                     // the loop of worker `id`
+
+    std::vector<std::unique_ptr<Simulator>> _contexts{};
+    std::vector<WorkQueue> _queues;
+    std::vector<Slot> _slots;        // input n is in _slots[n % _slots.size()]
+    std::atomic<size_t> _queued{0};  // tasks in the queues
+    std::atomic<size_t> _awaited{0}; // the input whose result run() waits for, 0 for none
+    std::mutex _mutex{};
+    std::condition_variable _work{}; // workers wait for tasks
+    std::condition_variable _done{}; // run() waits for results
+    bool _stop = false;              // guarded by _mutex
+    std::vector<std::thread> _threads{};
+};
+
+} // namespace fla
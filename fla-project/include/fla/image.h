@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fla {
+
+// Binary images of compiled machines, written by `fla compile`. An image is a header followed
+// by the tables of a CompiledPDA or CompiledTM, integers are stored in the byte order of the
+// machine that wrote them and images from a different byte order are rejected.
+constexpr char image_magic[4] = {'F', 'L', 'A', 'C'};
+constexpr uint32_t image_version = 2;
+constexpr uint32_t image_byte_order = 0x01020304;
+
+class ImageWriter {
+  public:
+    explicit ImageWriter(char kind) {
+        _data.append(image_magic, sizeof(image_magic));
+        u32(image_version);
+        u32(image_byte_order);
+        byte(kind);
+    };
+
+    void byte(char value) { _data.push_back(value); };
+    void u32(uint32_t value) { _data.append(reinterpret_cast<const char *>(&value), 4); };
+    void u64(uint64_t value) { _data.append(reinterpret_cast<const char *>(&value), 8); };
+    void string(const std::string &value) {
+        u64(value.size());
+        _data.append(value);
+    };
+    // The length and the bytes of an array of integers
+    template <typename T>
+    void array(const std::vector<T> &values) {
+        u64(values.size());
+        _data.append(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+    }
+
+    const std::string &data() const { return _data; };
+
+  private:
+    std::string _data{};
+};
+
+// Reads an image in place, every read throws std::out_of_range past the end of the data
+class ImageReader {
+  public:
+    ImageReader(const char *data, size_t size) : _data(data), _size(size) {};
+
+    // Checks the header, returns false if this is not an image of a machine of `kind`
+    bool header(char kind) {
+        if (_size < sizeof(image_magic) || std::memcmp(_data, image_magic, sizeof(image_magic)))
+            return false;
+        _offset = sizeof(image_magic);
+        return u32() == image_version && u32() == image_byte_order && byte() == kind;
+    };
+
+    char byte() { return *take(1); };
+    uint32_t u32() {
+        uint32_t value = 0;
+        std::memcpy(&value, take(4), 4);
+        return value;
+    };
+    uint64_t u64() {
+        uint64_t value = 0;
+        std::memcpy(&value, take(8), 8);
+        return value;
+    };
+    size_t size() { return static_cast<size_t>(u64()); };
+    std::string string() {
+        size_t size = this->size();
+        return std::string(take(size), size);
+    };
+    // An array written by ImageWriter::array(), copied in one piece
+    template <typename T>
+    void array(std::vector<T> &values) {
+        size_t count = size();
+        if (count > (_size - _offset) / sizeof(T))
+            throw std::out_of_range("truncated image");
+        values.resize(count);
+        if (count != 0)
+            std::memcpy(values.data(), take(count * sizeof(T)), count * sizeof(T));
+    }
+    // A view of the next `count` bytes
+    const char *bytes(size_t count) { return take(count); };
+
+    bool done() const { return _offset == _size; };
+
+  private:
+    const char *take(size_t count) {
+        if (count > _size - _offset)
+            throw std::out_of_range("truncated image");
+        const char *data = _data + _offset;
+        _offset += count;
+        return data;
+    };
+
+    const char *_data;
+    size_t _size;
+    size_t _offset = 0;
+};
+
+} // namespace fla
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace fla {
+
+// Input of a run, consumed front to back. It either views memory, such as a mapped file, or
+// reads a stream in chunks, so inputs larger than memory can be run.
+class InputCursor {
+  public:
+    // With `line` set, a line break at the very end is not part of the input
+    InputCursor(const char *data, size_t size, bool line = false);
+    explicit InputCursor(std::istream &in, bool line = false, size_t chunk_size = 1 << 16);
+    ~InputCursor() = default;
+
+    InputCursor(const InputCursor &) = delete;
+    InputCursor &operator=(const InputCursor &) = delete;
+
+    // Whether the input is used up, reads the next chunk when the current one runs out
+    bool empty() {
+        if (_end - _next <= 2 && _in)
+            refill();
+        if (_next == _end)
+            return true;
+        return _line && !_in && is_line_break(_next, _end);
+    };
+    char front() const { return *_next; };
+    void pop() { ++_next; };
+    // Number of characters consumed so far
+    size_t position() const { return _position + static_cast<size_t>(_next - _begin); };
+    // Whether reading the stream failed
+    bool failed() const { return _failed; };
+
+  private:
+    void refill();
+    static bool is_line_break(const char *begin, const char *end) {
+        return (end - begin == 1 && begin[0] == '\n') ||
+               (end - begin == 2 && begin[0] == '\r' && begin[1] == '\n');
+    };
+
+    std::istream *_in = nullptr; // null once the stream is exhausted
+    bool _line = false;
+    bool _failed = false;
+    size_t _chunk_size = 0;
+    std::vector<char> _buffer{};
+    const char *_begin = nullptr; // start of the current chunk
+    const char *_next = nullptr;
+    const char *_end = nullptr;
+    size_t _position = 0; // characters consumed before the current chunk
+};
+
+} // namespace fla
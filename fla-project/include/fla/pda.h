@@ -1,22 +1,65 @@
 #pragma once
 
+#include <fla/input.h>
 #include <fla/simulator.h>
 #include <fla/util.h>
 
 #include <map>
-#include <queue>
+#include <memory>
+#include <set>
 #include <tuple>
 #include <vector>
 
 namespace fla {
 
+// Read-only form of a parsed PDA, states and symbols are referred to by their id
+struct CompiledPDA {
+    struct Action {
+        size_t next_state = 0;
+        size_t push = 0;      // offset of the pushed symbols in `pushes`
+        size_t push_size = 0; // 0 for '_'
+    };
+
+    // Ids [first, last) of the actions for a condition, an empty range if there is none
+    std::pair<size_t, size_t> find_transitions(size_t state, char input_char,
+                                               char stack_top) const;
+    // Stores `push` as written in a transition, '_' for none, and returns the action
+    Action make_action(size_t next_state, const std::string &push);
+    // The push string of `action` as written in the transition
+    std::string push_string(const Action &action) const;
+
+    SymbolTable states{};
+    Alphabet input_alphabet{};
+    Alphabet stack_alphabet{};
+    char stack_start_symbol = '\0';
+    size_t start_state = 0;
+    bool nondeterministic = false;
+    std::vector<bool> accepting{};
+    std::vector<size_t> transition_offsets{}; // (state, input, stack top) -> first action id
+    std::vector<Action> actions{};            // grouped by condition, in file order
+    std::string pushes{}; // the push strings reversed, so a run appends them to the stack as is
+};
+
 class PDASimulator final : public Simulator {
   public:
     PDASimulator() = default;
     ~PDASimulator() override = default;
 
+    PDASimulator(const PDASimulator &) = delete;
+    PDASimulator &operator=(const PDASimulator &) = delete;
+
     void parse(const std::string &filepath) override;
-    void run(const std::string &input) override;
+    Result run(const std::string &input) override;
+    // Runs on input consumed through `input`, which is checked as it is read, so it never has
+    // to be in memory as a whole. Non-deterministic machines read it all before searching.
+    Result run(InputCursor &input);
+    void reset() noexcept override;
+    void save(const std::string &filepath) override;
+    void load(const std::string &filepath) override;
+    std::unique_ptr<Simulator> clone() const override;
+    // Writes the `-v` block of one configuration to `out`
+    static void print_step(std::ostream &out, size_t step, const std::string &state,
+                           const std::vector<char> &stack);
 
   private:
     // Parsing
@@ -28,31 +71,66 @@ class PDASimulator final : public Simulator {
     void parse_accept_states(const std::string &line);
     void parse_transitions(const std::string &line);
 
+    // Compiling
+    void compile();
+
     // Running
-    void step();
-    void halt() noexcept override;
+    // `input` is null when it is streamed
+    Result run_deterministic(const std::string *input);
+    bool step();
+    // Names the rules and states of a profiled run in _stats, and the state of each rule in
+    // _rule_states
+    void name_profile();
+    // Reports a character that is not an input symbol, `position` is its offset in the input
+    void input_error(char c, size_t position);
+    void halt(HaltReason reason) noexcept override;
+    // Whether the run is in a cycle of ε-moves that never shrinks the stack
+    bool in_epsilon_cycle();
+    void drop_epsilon_levels(size_t levels) noexcept;
+
+    // Breadth-first search over the configurations of a non-deterministic PDA
+    Result run_nondeterministic(const std::string &input);
 
     // Logging
     void print_state() const noexcept;
-    void print_stack() const noexcept;
+    void print_ring(); // the configurations kept by the trace ring
 
     // Configuration
     using Condition = std::tuple<State, char, char>;
     using Action = std::tuple<State, std::string>;
-    std::set<State> _states{};
+    SymbolTable _states{};
     Alphabet _input_alphabet{};
     Alphabet _stack_alphabet{};
     State _start_state{};
     std::string _stack_start_symbol{};
     std::set<State> _accept_states{};
-    std::map<Condition, Action> _transitions{};
+    std::multimap<Condition, Action> _transitions{};
+
+    // Compiled configuration, shared with every clone
+    std::shared_ptr<const CompiledPDA> _machine{};
 
     // Run-time data
     size_t _counter = 0;
-    std::queue<char> _input{};
+    InputCursor *_input = nullptr; // input of the current deterministic run
     std::vector<char> _stack{};
-    State _current_state{};
+    size_t _current_state = 0;
     bool _accept = false;
+
+    // The (state, stack top) keys met in the current run of ε-moves, by stack height. A key
+    // lives while the stack stays at or above its height, so meeting it again means a loop.
+    std::vector<std::vector<size_t>> _epsilon_levels{};
+    size_t _epsilon_live = 0;                 // number of live levels
+    std::vector<size_t> _epsilon_key_count{}; // live records of each key
+
+    // What the last steps of a run with a trace ring changed, so the configurations before
+    // them can be restored from the one it halted in
+    struct Undo {
+        size_t state; // state before the step
+        size_t size;  // stack size before the step
+        char top;     // stack top before the step
+    };
+    std::vector<Undo> _ring{}; // by step modulo its size
+    std::vector<size_t> _rule_states{}; // state of each action, see name_profile()
 };
 
 } // namespace fla
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fla {
+
+// Stacks of symbols stored as a tree of shared suffixes. Nodes are hash-consed, so two equal
+// stacks always have the same id and pushing never copies the symbols below.
+class SharedStacks {
+  public:
+    static constexpr size_t empty = 0;
+
+    SharedStacks() = default;
+    ~SharedStacks() = default;
+
+    size_t push(size_t stack, char symbol) {
+        size_t key = stack << 8 | static_cast<unsigned char>(symbol);
+        auto it = _ids.find(key);
+        if (it != _ids.end())
+            return it->second;
+
+        _nodes.push_back(Node{symbol, stack, _nodes[stack].depth + 1});
+        _ids.emplace(key, _nodes.size() - 1);
+        return _nodes.size() - 1;
+    }
+    char top(size_t stack) const { return _nodes[stack].symbol; }
+    size_t pop(size_t stack) const { return _nodes[stack].below; }
+    size_t size(size_t stack) const { return _nodes[stack].depth; }
+
+    // Copies a stack into `symbols`, bottom first
+    template <typename Container> void collect(size_t stack, Container &symbols) const {
+        symbols.clear();
+        for (; stack != empty; stack = pop(stack))
+            symbols.push_back(top(stack));
+        std::reverse(symbols.begin(), symbols.end());
+    }
+
+  private:
+    struct Node {
+        char symbol;
+        size_t below;
+        size_t depth;
+    };
+
+    std::vector<Node> _nodes{Node{'\0', empty, 0}};
+    std::unordered_map<size_t, size_t> _ids{};
+};
+
+} // namespace fla
@@ -1,11 +1,21 @@
 #pragma once
 
-#include <set>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace fla {
 
+class ImageReader;
+class ImageWriter;
+class TraceWriter;
+
 enum class Error {
     None,
 
@@ -16,6 +26,45 @@ enum class Error {
     OtherError,
 };
 
+enum class HaltReason {
+    Accept,       // the PDA read all its input in an accept state, or an NTM branch halted in one
+    NoTransition, // no transition applies to the current configuration
+    EmptyStack,   // the PDA stack is empty
+    Limit,        // the run exceeded one of its limits
+    Timeout,      // the run exceeded its wall-clock time
+    Loop,         // the run repeats itself and would never halt
+};
+
+// Which configurations verbose deterministic runs print. A step is printed if it is between
+// `first` and `last`, a multiple of `every` steps after `first` and, if `states` is not empty,
+// enters one of them from another state.
+struct TraceFilter {
+    size_t first = 0;
+    size_t last = 0;  // 0 for no limit
+    size_t every = 1; // 0 counts as 1
+    std::vector<std::string> states{};
+    // Keep only the last `ring` configurations and print the ones the filter selects when the
+    // run halts, 0 to print as the run goes. The first one kept counts as entering its state.
+    size_t ring = 0;
+};
+
+struct Result {
+    bool accept = false;
+    std::string output{}; // "true"/"false" for a PDA, the first tape for a TM
+    size_t steps = 0;
+    HaltReason reason = HaltReason::NoTransition;
+};
+
+// What the last deterministic run used and, with set_profile(), which rules it fired
+struct RunStats {
+    std::vector<size_t> tape_cells{}; // cells each tape visited
+    size_t max_stack = 0;             // deepest the stack grew
+    std::vector<std::string> rules{}; // each rule as written in the machine file
+    std::vector<uint64_t> fires{};    // times each rule fired
+    std::vector<std::string> states{};
+    std::vector<uint64_t> visits{}; // configurations met in each state, the last one included
+};
+
 class State {
   public:
     State() = default;
@@ -24,7 +73,7 @@ class State {
 
     void set_name(const std::string &name) { _name = name; };
 
-    static bool is_valid(std::string name);
+    static bool is_valid(const std::string &name);
 
     bool operator==(const State &rhs) const { return _name == rhs._name; }
     bool operator<(const State &rhs) const { return _name < rhs._name; }
@@ -37,19 +86,61 @@ class State {
     std::string _name{};
 };
 
+// Maps names to dense ids in order of first appearance
+class SymbolTable {
+  public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    SymbolTable() = default;
+    ~SymbolTable() = default;
+
+    size_t intern(const std::string &name);
+    size_t find(const std::string &name) const;
+
+    const std::string &name(size_t id) const { return _names[id]; };
+    size_t size() const { return _names.size(); };
+    bool empty() const { return _names.empty(); };
+
+  private:
+    std::unordered_map<std::string, size_t> _ids{};
+    std::vector<std::string> _names{};
+};
+
 class Alphabet {
   public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
     Alphabet() = default;
     ~Alphabet() = default;
 
-    static bool is_valid(std::string s);
-
-    void add(std::string s) { _alphabet.insert(s); };
-    bool contains(const std::string &s) const { return _alphabet.find(s) != _alphabet.end(); };
-    bool empty() const { return _alphabet.empty(); };
+    static bool is_valid(const std::string &s);
+
+    void add(std::string s);
+    bool contains(char c) const {
+        unsigned char symbol = static_cast<unsigned char>(c);
+        return (_members[symbol >> 6] >> (symbol & 63)) & 1;
+    };
+    bool contains(const std::string &s) const { return s.size() == 1 && contains(s[0]); };
+    bool empty() const { return _size == 0; };
+    size_t size() const { return _size; };
+    // Offset of the first character of `input` that is not in the alphabet, npos if there is none
+    size_t validate(const char *input, size_t size) const;
+    size_t validate(const std::string &input) const {
+        return validate(input.data(), input.size());
+    };
+
+    // Dense id of a symbol in order of declaration, npos if it is not in the alphabet
+    size_t id(char c) const {
+        size_t slot = _ids[static_cast<unsigned char>(c)];
+        return slot == 0 ? npos : slot - 1;
+    };
+    // The symbols in order of declaration
+    std::string symbols() const;
 
   private:
-    std::set<std::string> _alphabet{};
+    std::array<uint64_t, 4> _members{}; // one bit per character
+    size_t _size = 0;
+    std::array<size_t, 256> _ids{}; // id + 1, 0 for unknown symbols
 };
 
 class Simulator {
@@ -58,22 +149,88 @@ class Simulator {
     virtual ~Simulator() = default;
 
     virtual void parse(const std::string &filepath) = 0;
-    virtual void run(const std::string &input) = 0;
+    virtual Result run(const std::string &input) = 0;
     virtual void reset() noexcept;
     virtual void set_verbose(bool verbose) noexcept;
 
+    // Non-deterministic machines follow every applicable transition, must be set before parse()
+    void set_nondeterministic(bool nondeterministic) noexcept {
+        _nondeterministic = nondeterministic;
+    };
+    // Maximum number of distinct configurations a non-deterministic run may visit, 0 for no limit
+    void set_max_configurations(size_t max_configurations) noexcept {
+        _max_configurations = max_configurations;
+    };
+    // Per-run limits on steps, wall-clock time and tape or stack cells, 0 for no limit
+    void set_max_steps(size_t max_steps) noexcept { _max_steps = max_steps; };
+    void set_timeout(std::chrono::milliseconds timeout) noexcept { _timeout = timeout; };
+    void set_max_cells(size_t max_cells) noexcept { _max_cells = max_cells; };
+    // Stops a deterministic run that is caught in a cycle
+    void set_detect_cycles(bool detect_cycles) noexcept { _detect_cycles = detect_cycles; };
+    // Records the following deterministic runs in `trace`, null to stop. Traced runs step one
+    // transition at a time like verbose ones.
+    void set_trace(std::shared_ptr<TraceWriter> trace) noexcept { _trace = std::move(trace); };
+    void set_trace_filter(const TraceFilter &filter) { _filter = filter; };
+    // Counts how often deterministic runs fire each rule. Profiled TM runs use the threaded
+    // program or step through the transition index, never the other engines.
+    void set_profile(bool profile) noexcept { _profile = profile; };
+    const RunStats &stats() const { return _stats; };
+
+    // Writes the parsed machine as a binary image, which load() reads in place of parse()
+    virtual void save(const std::string &filepath) = 0;
+    virtual void load(const std::string &filepath) = 0;
+
+    // Returns a fresh simulator that shares the parsed machine of this one
+    virtual std::unique_ptr<Simulator> clone() const = 0;
+
     friend class SimulatorTest;
 
   protected:
-    virtual void halt() noexcept { _halted = true; };
+    virtual void halt(HaltReason reason) noexcept {
+        _halted = true;
+        _halt_reason = reason;
+    };
     virtual void error_handler();
+    void write_image(const std::string &filepath, const ImageWriter &image);
+    // Hands the image at `filepath` to `read`, which returns false if the image is malformed
+    void read_image(const std::string &filepath, char kind,
+                    const std::function<bool(ImageReader &)> &read);
+    // Whether a run that has taken `steps` steps and uses `cells` cells must stop, and why
+    bool limit_reached(size_t steps, size_t cells, HaltReason &reason) const noexcept;
+    // Whether the run is past its timeout, reads the clock
+    bool timed_out() const noexcept;
+    // Resets the trace filter for a run of a machine with `states`
+    void start_filter(const SymbolTable &states);
+    // Whether the trace filter prints the configuration of `step` in `state`, steps must come
+    // in order. Without a state filter the steps up to the next one due cost a compare.
+    bool selected(size_t step, size_t state) noexcept {
+        if (step < _next_print && _entered.empty())
+            return false;
+        return select(step, state);
+    };
+    bool select(size_t step, size_t state) noexcept;
 
     bool _verbose = false;
+    bool _nondeterministic = false;
+    size_t _max_configurations = 1000000;
+    size_t _max_steps = 0;
+    std::chrono::milliseconds _timeout{0};
+    size_t _max_cells = 0;
+    bool _detect_cycles = false;
+    std::shared_ptr<TraceWriter> _trace{};
+    TraceFilter _filter{};
+    bool _profile = false;
+    RunStats _stats{};
+    size_t _next_print = 0;       // the next step the filter may select
+    std::vector<bool> _entered{}; // states whose entry is printed, empty for any state
+    size_t _previous_state = 0;   // state of the last step passed to select()
 
     std::vector<std::string> _error_logs{};
     Error _error = Error::None;
 
     bool _halted = false;
+    HaltReason _halt_reason = HaltReason::NoTransition;
+    std::chrono::steady_clock::time_point _deadline{};
 };
 
 } // namespace fla
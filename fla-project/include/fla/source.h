@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+namespace fla {
+
+// A read-only view of a whole file. The file is memory-mapped where the platform allows it,
+// otherwise it is read into a buffer.
+class SourceFile {
+  public:
+    explicit SourceFile(const std::string &filepath);
+    ~SourceFile();
+
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    bool is_open() const { return _open; };
+    const char *data() const { return _data; };
+    size_t size() const { return _size; };
+
+    // Reads the next line without its '\n' like std::getline, returns false at the end
+    bool next_line(std::string &line);
+
+  private:
+    bool _open = false;
+    bool _mapped = false;
+    const char *_data = nullptr;
+    size_t _size = 0;
+    size_t _offset = 0;
+    std::string _buffer{};
+};
+
+} // namespace fla
@@ -3,10 +3,14 @@
 #include <fla/simulator.h>
 #include <fla/util.h>
 
+#include <array>
 #include <cassert>
-#include <deque>
+#include <cstdint>
+#include <memory>
+#include <set>
 #include <string>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 namespace fla {
@@ -29,31 +33,242 @@ class SymbolSeq {
     std::string _symbol_seq;
 };
 
+// A tape stored in one flat buffer that grows geometrically in both directions. Blank cells
+// are never trimmed while running, only when the tape is printed or converted to a string.
 class Tape {
   public:
     Tape() = default;
     ~Tape() = default;
 
-    void init(const std::string &input) {
-        if (!input.empty())
-            _tape.assign(input.begin(), input.end());
-    };
+    void init(const std::string &input);
+    // Loads `cells` with the head on cells[head] and cells[0] at position `first`
+    void init(const std::string &cells, size_t head, int first);
     char read() const {
-        assert(_head >= 0 && _head < static_cast<int>(_tape.size()));
-        return _tape[static_cast<size_t>(_head)];
+        assert(_head < _cells.size());
+        return _cells[_head];
+    };
+    void step(char symbol, char direction) {
+        if (symbol != '*')
+            write(_head, symbol);
+
+        if (direction == 'l') {
+            if (_head == 0)
+                grow_left();
+            if (--_head < _low)
+                _low = _head;
+        } else if (direction == 'r') {
+            if (_head + 1 == _cells.size())
+                grow_right();
+            if (++_head > _high)
+                _high = _head;
+        }
+    };
+
+    // Position of the head, cell 0 holds the first input symbol
+    int head() const { return position(_head); };
+    // Appends the `size` cells from position `first` on to `block`
+    void read_block(int first, size_t size, std::string &block) const;
+    // Writes `block` from position `first` on, marks the cells from `low` to `high` as visited
+    // and moves the head to `head`
+    void write_block(int first, const std::string &block, int low, int high, int head);
+
+    // Number of cells the tape has visited
+    size_t size() const { return _high - _low + 1; };
+    // Fingerprint of the tape contents and the head position, equal tapes have equal hashes
+    uint64_t hash() const { return _hash + mix(static_cast<uint64_t>(position(_head))); };
+    bool operator==(const Tape &rhs) const;
+
+    std::string to_string() const;
+    // Writes the index, cell and head lines of `-v`, labelled with `idx` and padded to `width`
+    void print(std::ostream &out, size_t idx, size_t width) const;
+
+  private:
+    void grow_left();
+    void grow_right();
+    void write(size_t index, char symbol) {
+        if (symbol != _cells[index]) {
+            _hash += cell_hash(position(index), symbol) - cell_hash(position(index), _cells[index]);
+            _cells[index] = symbol;
+        }
+    };
+
+    // Index range [begin, end) of the cells from the first to the last non-blank one, widened
+    // to include the head
+    void window(size_t &begin, size_t &end) const;
+    int position(size_t index) const { return static_cast<int>(index) - _origin; };
+    char at(int position) const;
+    // Contribution of one cell to the hash, blank cells contribute nothing
+    static uint64_t cell_hash(int position, char symbol) {
+        if (symbol == '_')
+            return 0;
+        return mix(static_cast<uint64_t>(static_cast<uint32_t>(position)) << 8 |
+                   static_cast<unsigned char>(symbol));
+    };
+
+    std::vector<char> _cells = std::vector<char>(1, '_');
+    int _origin = 0;    // index of cell 0
+    size_t _head = 0;   // index of the head
+    size_t _low = 0;    // every cell outside [_low, _high] is blank
+    size_t _high = 0;
+    uint64_t _hash = 0; // sum of the cell hashes
+};
+
+// Bytecode of a deterministic TM, one block per state. A block branches on the symbol under
+// each head in turn and ends in the action of the first matching rule, or in a halt.
+struct ThreadedProgram {
+    enum class Opcode : uint8_t { Halt, Branch, Apply };
+    struct Instruction {
+        const void *handler; // address of the opcode's handler when dispatch is threaded
+        Opcode opcode;
+        uint32_t tape;    // Branch: tape whose symbol is read
+        uint32_t operand; // Branch: offset in targets, Apply: offset in actions
+        uint32_t next;    // Apply: block of the next state
+        uint32_t state;   // Apply: next state
+    };
+
+    bool empty() const { return code.empty(); };
+
+    size_t tape_number = 0;
+    std::array<uint8_t, 256> ids{};      // symbol -> id
+    std::vector<Instruction> code{};     // code[0] halts, code[1 + i] applies rule i
+    std::vector<uint32_t> blocks{};      // state -> first instruction
+    std::vector<uint32_t> targets{};     // Branch: instruction for each symbol id
+    std::vector<char> actions{};         // Apply: symbols written, then moves, per tape
+};
+
+// A tape stored as runs of equal symbols around the head, for tapes with long stretches of
+// one symbol. Moving inside a run only changes an offset, and a write splits the run under the
+// head and merges the new cell with equal neighbours. Neighbouring runs always differ.
+class RunLengthTape {
+  public:
+    RunLengthTape() = default;
+    ~RunLengthTape() = default;
+
+    void init(const std::string &input);
+    char read() const { return _current.symbol; };
+    void step(char symbol, char direction) {
+        if (symbol != '*' && symbol != _current.symbol)
+            write(symbol);
+
+        if (direction == 'l') {
+            if (_offset > 0)
+                _offset--;
+            else
+                move_left();
+            if (--_position < _low)
+                _low = _position;
+        } else if (direction == 'r') {
+            if (_offset + 1 < _current.length)
+                _offset++;
+            else
+                move_right();
+            if (++_position > _high)
+                _high = _position;
+        }
     };
-    void step(char symbol, char direction);
 
-    std::string to_string();
-    void print(size_t idx, int width) const;
+    // Number of cells the tape has visited
+    size_t size() const { return static_cast<size_t>(_high - _low) + 1; };
+    // Number of runs the tape is stored in
+    size_t runs() const { return _left.size() + 1 + _right.size(); };
+    // Expands the runs, without the blanks at both ends
+    std::string to_string() const;
 
   private:
-    void expand();
-    void shrink();
+    struct Run {
+        char symbol;
+        size_t length;
+    };
 
-    int _offset = 0;
-    int _head = 0;
-    std::deque<char> _tape{'_'};
+    void write(char symbol);
+    void move_left();
+    void move_right();
+
+    std::vector<Run> _left{};  // runs left of the head, the nearest at the back
+    Run _current{'_', 1};      // run under the head
+    size_t _offset = 0;        // offset of the head in the current run
+    std::vector<Run> _right{}; // runs right of the head, the nearest at the back
+    int _position = 0;         // position of the head, cell 0 holds the first input symbol
+    int _low = 0;              // leftmost and rightmost positions visited
+    int _high = 0;
+};
+
+// Read-only form of a parsed TM, states are referred to by their id
+struct CompiledTM {
+    // A transition, its strings point into rule_symbols and hold one symbol per tape
+    struct Transition {
+        size_t state;
+        const char *old_str;
+        const char *new_str;
+        const char *direction;
+        size_t next_state;
+    };
+
+    size_t transition_count() const noexcept { return next_states.size(); }
+    Transition transition(size_t id) const noexcept {
+        const char *symbols = rule_symbols.data() + 3 * tape_number * id;
+        return Transition{rule_states[id], symbols, symbols + tape_number,
+                          symbols + 2 * tape_number, next_states[id]};
+    }
+    // Appends a transition, build_index() indexes it
+    void add_transition(size_t state, const std::string &old_str, const std::string &new_str,
+                        const std::string &direction, size_t next_state);
+
+    // Returns the id of the first matching transition, or transition_count() if there is none
+    size_t find_transition(size_t state, const SymbolSeq &symbols) const;
+    // Collects the ids of every matching transition in file order
+    void find_transitions(size_t state, const SymbolSeq &symbols, std::vector<size_t> &ids) const;
+    // Rebuilds transition_offsets and rule_index from the transitions
+    void build_index();
+    // Builds dense_table if the machine is deterministic, has at most 4 tapes and 16 symbols,
+    // and the table takes at most `limit` bytes
+    void build_dense_table(size_t limit);
+    // Builds program if the machine is deterministic and the program takes at most `limit` bytes
+    void build_program(size_t limit);
+    // Every symbol a tape can hold: the blank first, the input and whatever is written
+    std::string tape_symbols() const;
+
+    SymbolTable states{};
+    Alphabet input_alphabet{};
+    size_t tape_number = 0;
+    size_t start_state = 0;
+    bool nondeterministic = false;
+    std::vector<bool> accepting{};
+
+    // The transitions as fixed-width records in file order: rule i goes from rule_states[i]
+    // to next_states[i], and reads, writes and moves the tapes as given by the 3 * tape_number
+    // symbols from rule_symbols[3 * tape_number * i]
+    std::vector<uint32_t> rule_states{};
+    std::vector<uint32_t> next_states{};
+    std::string rule_symbols{};
+    // Per-state index over the rules in CSR form. The rules of state q are
+    // rule_index[transition_offsets[2q], transition_offsets[2q + 2]): first the ones without
+    // '*', sorted by read string and in file order among equal ones, then from
+    // transition_offsets[2q + 1] the ones with '*' in file order.
+    std::vector<uint32_t> transition_offsets{};
+    std::vector<uint32_t> rule_index{};
+
+    // The transition function as one flat table with the wildcards expanded. The entry of
+    // `state * |dense_symbols|^k + encoded symbols` packs the next state (bits 0-31), the id
+    // of the symbol written on each tape (4 bits each from bit 32), the move of each tape
+    // (2 bits each from bit 48) and whether a transition applies (bit 63).
+    static constexpr uint64_t dense_valid = uint64_t(1) << 63;
+    std::string dense_symbols{};          // id -> symbol, the blank has id 0
+    std::array<uint8_t, 256> dense_ids{}; // symbol -> id
+    std::vector<uint64_t> dense_table{};
+    ThreadedProgram program{};
+};
+
+// How a deterministic TM run stores its tapes
+enum class TapeBackend {
+    Flat,      // one cell per byte
+    RunLength, // runs of equal symbols, see RunLengthTape
+};
+
+enum class SearchStrategy {
+    BreadthFirst,
+    DepthFirst,
+    IterativeDeepening, // depth-first with a depth bound that doubles until the search completes
 };
 
 class TMSimulator : public Simulator {
@@ -62,7 +277,33 @@ class TMSimulator : public Simulator {
     ~TMSimulator() override = default;
 
     void parse(const std::string &filepath) override;
-    void run(const std::string &input) override;
+    Result run(const std::string &input) override;
+    void reset() noexcept override;
+    void save(const std::string &filepath) override;
+    void load(const std::string &filepath) override;
+    std::unique_ptr<Simulator> clone() const override;
+    // Writes a standalone C++ simulator of the parsed deterministic machine
+    void codegen(const std::string &filepath);
+    // Writes the `-v` block of one configuration to `out`
+    static void print_step(std::ostream &out, size_t step, const std::string &state,
+                           const std::vector<Tape> &tapes);
+
+    // Order in which a non-deterministic TM explores its configurations
+    void set_search_strategy(SearchStrategy strategy) noexcept { _search_strategy = strategy; };
+    // Memory the dense transition table and the threaded program may each take, 0 to always
+    // use the general engine. Must be set before parse() or load().
+    void set_table_limit(size_t limit) noexcept { _table_limit = limit; };
+    // Width of the tape blocks whose sweeps are cached as macro steps, 0 to step cell by cell.
+    // Only single-tape machines run without a trace or cycle detection use them.
+    void set_macro_block(size_t width) noexcept { _macro_block = width; };
+    // Tape storage of the following runs. Run-length tapes are used by deterministic runs
+    // without a trace or cycle detection.
+    void set_tape_backend(TapeBackend backend) noexcept { _tape_backend = backend; };
+    // Report every rule that overlaps earlier rules of its state on stderr, instead of stopping
+    // at the first one. Must be set before parse().
+    void set_check_overlaps(bool check) noexcept { _check_overlaps = check; };
+
+    friend class TMSimulatorTest;
 
   private:
     // Parsing
@@ -74,18 +315,43 @@ class TMSimulator : public Simulator {
     void parse_accept_states(const std::string &line);
     void parse_tape_number(const std::string &line);
     void parse_transitions(const std::string &line);
+    // Earlier rules of `state` whose read strings overlap `read`, in file order. Stops at the
+    // first one unless `all` is set.
+    void find_overlaps(const std::string &state, const std::string &read, bool all,
+                       std::vector<size_t> &rules) const;
+    // Whether `rules` match every combination of symbols `read` matches
+    bool covered(const std::string &read, const std::vector<size_t> &rules) const;
+
+    // Compiling
+    void compile();
 
     // Running
-    void step();
-    void halt() noexcept override;
+    bool step();
+    bool step_dense(); // step() through the dense transition table
+    // Records the step just taken, which wrote `symbols` and moved in `directions`
+    void record_step(const char *symbols, const char *directions);
+    // Runs through the threaded program until a halt or step `until`
+    void run_threaded(size_t until = static_cast<size_t>(-1));
+    void run_macro();     // runs until a halt with cached macro steps where possible
+    bool macro_step();    // moves the head across its block in one step, if possible
+    Result run_run_length(const std::string &input); // runs on run-length tapes
+    size_t cells() const; // tape cells in use
+    Result finish(); // the result of a deterministic run on _tapes, records its stats
+    void name_profile(); // names the rules and states of a profiled run in _stats
+    bool in_cycle();       // whether the run is back in a configuration it has been in
+    void halt(HaltReason reason) noexcept override;
+
+    // Search for an accepting halt over the configurations of a non-deterministic TM
+    Result run_nondeterministic(const std::string &input);
 
     // Logging
     void print_state();
+    void print_ring(); // the configurations kept by the trace ring
 
     // Configuration
     using Condition = std::tuple<State, SymbolSeq>;
     using Action = std::tuple<SymbolSeq, std::string, State>;
-    std::set<State> _states{};
+    SymbolTable _states{};
     Alphabet _input_alphabet{};
     Alphabet _tape_alphabet{};
     State _start_state{};
@@ -94,11 +360,57 @@ class TMSimulator : public Simulator {
     size_t _tape_number = 0;
     std::vector<std::pair<Condition, Action>> _transitions{};
 
+    // The rules of a state by read string, so overlapping conditions are found while parsing
+    // without comparing every pair of rules
+    struct ConditionIndex {
+        // read string without '*' -> rules, several only in a NTM
+        std::unordered_map<std::string, std::vector<size_t>> exact{};
+        std::vector<size_t> exact_rules{};
+        std::vector<size_t> wildcard_rules{};
+    };
+    std::unordered_map<std::string, ConditionIndex> _conditions{}; // by state name
+    bool _check_overlaps = false;
+    size_t _overlaps = 0; // rules found overlapping with _check_overlaps
+
+    // Compiled configuration, shared with every clone
+    std::shared_ptr<const CompiledTM> _machine{};
+    SearchStrategy _search_strategy = SearchStrategy::BreadthFirst;
+    size_t _table_limit = 16 << 20;
+    size_t _macro_block = 0;
+    TapeBackend _tape_backend = TapeBackend::Flat;
+
     // Run-time data
     size_t _counter = 0;
     std::vector<Tape> _tapes{};
-    State _current_state{};
+    size_t _current_state = 0;
     bool _accept = false;
+
+    // Cycle detection, Brent's algorithm compares each configuration with the one saved at
+    // the last power of two steps
+    size_t _next_save = 0;
+    size_t _saved_state = 0;
+    uint64_t _saved_hash = 0;
+    std::vector<Tape> _saved_tapes{};
+
+    // What the last steps of a run with a trace ring changed, by step modulo the ring size, so
+    // the configurations before them can be restored from the one it halted in
+    std::vector<size_t> _ring_states{}; // state before the step
+    std::vector<int> _ring_heads{};     // head of each tape before the step
+    std::string _ring_symbols{};        // symbol under each head before the step
+
+    // What happens from a state with the head on an edge of a block until it leaves the block.
+    // Empty if the machine halts or keeps running inside the block.
+    struct MacroStep {
+        std::string block;
+        size_t state;
+        size_t steps;
+        int exit; // offset of the cell the head moves to, -1 or the block width
+        int low;  // offsets of the leftmost and rightmost cells visited, including the exit
+        int high;
+    };
+    MacroStep simulate_block(size_t state, std::string block, int offset) const;
+    std::unordered_map<std::string, MacroStep> _macro_steps{}; // keyed by state, edge and block
+    std::string _macro_key{};
 };
 
 } // namespace fla
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <fla/simulator.h>
+
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace fla {
+
+// Binary traces of deterministic runs, written with `--trace` and rendered by
+// `fla trace-render`. A trace starts with the magic and the version, then holds one or more
+// runs. A run record names the machine and its start configuration, each step record holds
+// only what the step changed and an end record closes the run, so the renderer replays the
+// run to print what `-v` prints. Sizes are unsigned LEB128.
+constexpr char trace_magic[4] = {'F', 'L', 'A', 'T'};
+constexpr char trace_version = 1;
+
+// Record tags
+constexpr char trace_run = 'R';  // kind ('P' or 'T'), the state names, the start configuration
+constexpr char trace_step = 'S'; // the next state and the changes of the step
+constexpr char trace_end = 'E';  // the run halted
+
+// Writes a trace through a large buffer, so a step costs a few bytes of memory traffic
+class TraceWriter {
+  public:
+    explicit TraceWriter(const std::string &filepath, size_t buffer_size = 1 << 20);
+    ~TraceWriter() { flush(); };
+
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    bool is_open() const { return _out.is_open(); };
+    // Whether everything flushed so far was written
+    bool good() const { return static_cast<bool>(_out); };
+
+    void byte(char value) {
+        if (_used == _buffer.size())
+            flush();
+        _buffer[_used++] = value;
+    };
+    void size(size_t value) {
+        for (; value >= 0x80; value >>= 7)
+            byte(static_cast<char>((value & 0x7f) | 0x80));
+        byte(static_cast<char>(value));
+    };
+    void bytes(const char *data, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            byte(data[i]);
+    };
+    void string(const std::string &value) {
+        size(value.size());
+        bytes(value.data(), value.size());
+    };
+    // Starts a run record of a machine of `kind` with `states`
+    void run(char kind, const SymbolTable &states);
+    void flush();
+
+  private:
+    std::ofstream _out;
+    std::vector<char> _buffer;
+    size_t _used = 0;
+};
+
+// Writes the `-v` layout of every run in the trace at `filepath` to `out`. Returns false if
+// the file can not be read or is not a trace, what was rendered before stays in `out`.
+bool render_trace(const std::string &filepath, std::ostream &out);
+
+} // namespace fla
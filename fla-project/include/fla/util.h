@@ -1,7 +1,10 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <vector>
 
 namespace fla {
 
@@ -28,4 +31,71 @@ static inline void ignore_after(std::string &s, char ch) {
     }
 }
 
+// Splits `s` at whitespace like repeated `std::istream >> item`
+static inline void split_whitespace(const std::string &s, std::vector<std::string> &items) {
+    items.clear();
+    size_t i = 0;
+    while (true) {
+        while (i < s.size() && std::isspace(static_cast<unsigned char>(s[i])))
+            i++;
+        if (i == s.size())
+            return;
+        size_t begin = i;
+        while (i < s.size() && !std::isspace(static_cast<unsigned char>(s[i])))
+            i++;
+        items.emplace_back(s, begin, i - begin);
+    }
+}
+
+// Matches a whole line of the form `#<key> = {<set>}` with a non-empty set without '}', or
+// `#<key> = <value>` with a non-empty value without ' ', and extracts the set or the value
+static inline bool match_directive(const std::string &line, const std::string &key, bool set,
+                                   std::string &value) {
+    size_t begin = key.size() + 3 + (set ? 1 : 0);
+    if (line.size() <= begin || line.compare(0, key.size(), key) != 0 ||
+        line.compare(key.size(), 3, " = ") != 0)
+        return false;
+
+    if (set) {
+        if (line[begin - 1] != '{' || line.back() != '}' || line.size() == begin + 1)
+            return false;
+        size_t end = line.size() - 1;
+        if (line.find('}', begin) != end)
+            return false;
+        value.assign(line, begin, end - begin);
+    } else {
+        if (line.find(' ', begin) != std::string::npos)
+            return false;
+        value.assign(line, begin, std::string::npos);
+    }
+    return true;
+}
+
+// Number of decimal digits of `value`
+static inline size_t digits(size_t value) {
+    size_t count = 1;
+    for (; value >= 10; value /= 10)
+        count++;
+    return count;
+}
+
+// Appends `text` padded with spaces to `width` characters, like std::left << std::setw(width)
+static inline void append_padded(std::string &line, const std::string &text, size_t width) {
+    line += text;
+    if (text.size() < width)
+        line.append(width - text.size(), ' ');
+}
+
+// Mixes the hash of `value` into `seed`
+static inline void hash_combine(size_t &seed, size_t value) {
+    seed ^= std::hash<size_t>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+// Scrambles the bits of `x`, the finalizer of splitmix64
+static inline uint64_t mix(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
 } // namespace fla
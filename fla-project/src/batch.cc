@@ -0,0 +1,189 @@
+#include <fla/batch.h>
+
+#include <algorithm>
+
+namespace fla {
+
+namespace {
+
+// Inputs each worker may run ahead of the oldest unfinished one
+const size_t window_per_job = 1024;
+// Inputs read before they are handed out together, so workers are woken once per batch
+const size_t batch_size = 256;
+
+size_t job_count(size_t jobs) {
+    return jobs != 0 ? jobs : std::max(1u, std::thread::hardware_concurrency());
+}
+
+} // namespace
+
+BatchRunner::BatchRunner(const Simulator &simulator, size_t jobs)
+    : _queues(job_count(jobs)), _slots(job_count(jobs) * window_per_job) {
+    for (size_t i = 0; i < _queues.size(); ++i)
+        _contexts.push_back(simulator.clone());
+
+    for (size_t id = 0; id < _queues.size() && _queues.size() > 1; ++id)
+        _threads.emplace_back(&BatchRunner::work, this, id);
+}
+
+BatchRunner::~BatchRunner() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _work.notify_all();
+    for (std::thread &thread : _threads)
+        thread.join();
+}
+
+// Takes the next task of worker `id`, or steals half of the tasks left to another worker
+bool BatchRunner::next_task(size_t id, size_t &task) {
+    {
+        std::lock_guard<std::mutex> lock(_queues[id].mutex);
+        if (!_queues[id].tasks.empty()) {
+            task = _queues[id].tasks.front();
+            _queues[id].tasks.pop_front();
+            _queued--;
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < _queues.size(); ++i) {
+        WorkQueue &victim = _queues[(id + i) % _queues.size()];
+        std::deque<size_t> stolen{};
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty())
+                continue;
+            size_t count = (victim.tasks.size() + 1) / 2;
+            stolen.assign(victim.tasks.end() - static_cast<std::ptrdiff_t>(count),
+                          victim.tasks.end());
+            victim.tasks.erase(victim.tasks.end() - static_cast<std::ptrdiff_t>(count),
+                               victim.tasks.end());
+        }
+
+        task = stolen.front();
+        stolen.pop_front();
+        _queued--;
+        std::lock_guard<std::mutex> lock(_queues[id].mutex);
+        _queues[id].tasks.insert(_queues[id].tasks.end(), stolen.begin(), stolen.end());
+        return true;
+    }
+
+    return false;
+}
+
+void BatchRunner::work(size_t id) {
+    Simulator &simulator = *_contexts[id];
+    while (true) {
+        size_t task = 0;
+        if (!next_task(id, task)) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _work.wait(lock, [this]() { return _stop || _queued != 0; });
+            if (_stop)
+                return;
+            continue;
+        }
+
+        Slot &slot = _slots[task % _slots.size()];
+        slot.result = BatchResult{};
+        try {
+            slot.result.result = simulator.run(slot.input);
+        } catch (const Error &e) {
+            slot.result.error = e;
+        }
+
+        // run() either sees the flag before it waits or is woken once it does
+        slot.ready = true;
+        if (_awaited == task + 1) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _done.notify_one();
+        }
+    }
+}
+
+void BatchRunner::run(const std::function<bool(std::string &)> &next,
+                      const std::function<void(const BatchResult &)> &done) {
+    if (_threads.empty()) {
+        Simulator &simulator = *_contexts[0];
+        Slot &slot = _slots[0];
+        while (next(slot.input)) {
+            slot.result = BatchResult{};
+            try {
+                slot.result.result = simulator.run(slot.input);
+            } catch (const Error &e) {
+                slot.result.error = e;
+            }
+            done(slot.result);
+        }
+        return;
+    }
+
+    size_t window = _slots.size();
+    size_t read = 0;    // inputs handed out
+    size_t emitted = 0; // results passed to `done`
+    bool more = true;
+    while (true) {
+        // Pass on the finished results at the front of the window
+        for (; emitted < read && _slots[emitted % window].ready; ++emitted) {
+            Slot &slot = _slots[emitted % window];
+            done(slot.result);
+            slot.ready = false;
+        }
+
+        size_t first = read;
+        while (more && read - emitted < window && read - first < batch_size) {
+            more = next(_slots[read % window].input);
+            read += more;
+        }
+
+        if (read != first) {
+            // Every worker gets a contiguous part of the batch, stealing evens out the rest
+            size_t count = read - first;
+            for (size_t i = 0; i < _queues.size(); ++i) {
+                size_t begin = first + i * count / _queues.size();
+                size_t end = first + (i + 1) * count / _queues.size();
+                std::lock_guard<std::mutex> lock(_queues[i].mutex);
+                for (size_t task = begin; task < end; ++task)
+                    _queues[i].tasks.push_back(task);
+            }
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _queued += count;
+            }
+            _work.notify_all();
+            continue;
+        }
+
+        if (emitted == read)
+            return;
+
+        // Wait for the oldest result and the one a batch later, so the window moves on by
+        // about a batch at a time
+        for (size_t awaited : {emitted, std::min(read, emitted + batch_size) - 1}) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _awaited = awaited + 1;
+            _done.wait(lock, [this, awaited, window]() {
+                return _slots[awaited % window].ready.load();
+            });
+        }
+        _awaited = 0;
+    }
+}
+
+std::vector<BatchResult> BatchRunner::run(const std::vector<std::string> &inputs) {
+    std::vector<BatchResult> results{};
+    results.reserve(inputs.size());
+    size_t next = 0;
+    run(
+        [&inputs, &next](std::string &input) {
+            if (next == inputs.size())
+                return false;
+            input = inputs[next++];
+            return true;
+        },
+        [&results](const BatchResult &result) { results.push_back(result); });
+    return results;
+}
+
+} // namespace fla
@@ -0,0 +1,34 @@
+#include <fla/input.h>
+
+#include <cstring>
+
+namespace fla {
+
+InputCursor::InputCursor(const char *data, size_t size, bool line)
+    : _line(line), _begin(data), _next(data), _end(data + size) {}
+
+InputCursor::InputCursor(std::istream &in, bool line, size_t chunk_size)
+    : _in(&in), _line(line), _chunk_size(chunk_size), _buffer(chunk_size + 2) {
+    _begin = _next = _end = _buffer.data();
+}
+
+void InputCursor::refill() {
+    // Keep the unread characters, at most two, so a final line break can be recognised
+    size_t left = static_cast<size_t>(_end - _next);
+    _position += static_cast<size_t>(_next - _begin);
+    std::memmove(_buffer.data(), _next, left);
+    _begin = _next = _buffer.data();
+
+    while (_in && left <= 2) {
+        _in->read(_buffer.data() + left, static_cast<std::streamsize>(_chunk_size));
+        size_t count = static_cast<size_t>(_in->gcount());
+        if (count == 0) {
+            _failed = _in->bad();
+            _in = nullptr;
+        }
+        left += count;
+    }
+    _end = _begin + left;
+}
+
+} // namespace fla
@@ -0,0 +1,126 @@
+#include <fla/pda.h>
+#include <fla/shared_stacks.h>
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <unordered_set>
+
+namespace fla {
+
+namespace {
+
+struct Configuration {
+    size_t state;
+    size_t position; // number of input characters read
+    size_t stack;
+
+    bool operator==(const Configuration &rhs) const {
+        return state == rhs.state && position == rhs.position && stack == rhs.stack;
+    }
+};
+
+struct ConfigurationHash {
+    size_t operator()(const Configuration &configuration) const {
+        size_t seed = std::hash<size_t>()(configuration.state);
+        hash_combine(seed, configuration.position);
+        hash_combine(seed, configuration.stack);
+        return seed;
+    }
+};
+
+} // namespace
+
+Result PDASimulator::run_nondeterministic(const std::string &input) {
+    SharedStacks stacks{};
+    std::deque<Configuration> frontier{};
+    std::unordered_set<Configuration, ConfigurationHash> visited{};
+
+    auto visit = [&frontier, &visited](const Configuration &configuration) {
+        if (visited.insert(configuration).second)
+            frontier.push_back(configuration);
+    };
+    auto apply = [this, &stacks, &visit](size_t position, size_t stack,
+                                         std::pair<size_t, size_t> actions) {
+        for (size_t i = actions.first; i < actions.second; ++i) {
+            const CompiledPDA::Action &action = _machine->actions[i];
+            if (_profile)
+                _stats.fires[i]++;
+            size_t next_stack = stack;
+            for (size_t j = 0; j < action.push_size; ++j) // the first symbol ends on top
+                next_stack = stacks.push(next_stack, _machine->pushes[action.push + j]);
+            visit(Configuration{action.next_state, position, next_stack});
+        }
+    };
+
+    if (_verbose) {
+        std::cout << "Input: " + input << std::endl;
+        std::cout << "==================== RUN ====================" << std::endl;
+    }
+
+    // A profile counts the branches each action starts and the configurations explored in
+    // each state
+    if (_profile) {
+        _stats.fires.assign(_machine->actions.size(), 0);
+        _stats.visits.assign(_machine->states.size(), 0);
+    }
+
+    visit(Configuration{_machine->start_state, 0,
+                        stacks.push(SharedStacks::empty, _machine->stack_start_symbol)});
+
+    while (!frontier.empty()) {
+        if (_max_configurations != 0 && visited.size() > _max_configurations) {
+            halt(HaltReason::Limit);
+            break;
+        }
+
+        Configuration configuration = frontier.front();
+        frontier.pop_front();
+        _stats.max_stack = std::max(_stats.max_stack, stacks.size(configuration.stack));
+        if (_profile)
+            _stats.visits[configuration.state]++;
+
+        if (_verbose) {
+            _current_state = configuration.state;
+            stacks.collect(configuration.stack, _stack);
+            print_state();
+        }
+
+        if (configuration.position == input.size() && _machine->accepting[configuration.state]) {
+            _accept = true;
+            halt(HaltReason::Accept);
+            break;
+        }
+
+        if (configuration.stack == SharedStacks::empty)
+            continue;
+
+        HaltReason limit = HaltReason::Limit;
+        if (limit_reached(_counter, stacks.size(configuration.stack), limit)) {
+            halt(limit);
+            break;
+        }
+
+        char stack_top = stacks.top(configuration.stack);
+        size_t below = stacks.pop(configuration.stack);
+
+        apply(configuration.position, below,
+              _machine->find_transitions(configuration.state, '_', stack_top));
+        if (configuration.position < input.size()) {
+            apply(configuration.position + 1, below,
+                  _machine->find_transitions(configuration.state, input[configuration.position],
+                                             stack_top));
+        }
+
+        _counter++;
+    }
+
+    if (!_halted) // every branch died
+        halt(HaltReason::NoTransition);
+    if (_profile)
+        name_profile();
+
+    return Result{_accept, _accept ? "true" : "false", _counter, _halt_reason};
+}
+
+} // namespace fla
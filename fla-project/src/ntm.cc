@@ -0,0 +1,270 @@
+#include <fla/shared_stacks.h>
+#include <fla/tm.h>
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+
+namespace fla {
+
+namespace {
+
+// A tape as a zipper around its head. Both sides are shared stacks that never end with a
+// blank cell, so equal tape contents always have equal ids and branching copies nothing.
+struct TapeView {
+    size_t left;  // cells left of the head, the nearest on top
+    char symbol;  // cell under the head
+    size_t right; // cells right of the head, the nearest on top
+    int head;     // position of the head, only used for the trace
+};
+
+struct Configuration {
+    size_t state;
+    size_t depth;
+    std::vector<TapeView> tapes;
+};
+
+// Configurations that only differ in depth or head positions behave the same
+struct ConfigurationHash {
+    size_t operator()(const Configuration &configuration) const {
+        size_t seed = std::hash<size_t>()(configuration.state);
+        for (const TapeView &tape : configuration.tapes) {
+            hash_combine(seed, tape.left);
+            hash_combine(seed, static_cast<unsigned char>(tape.symbol));
+            hash_combine(seed, tape.right);
+        }
+        return seed;
+    }
+};
+
+struct ConfigurationEqual {
+    bool operator()(const Configuration &lhs, const Configuration &rhs) const {
+        if (lhs.state != rhs.state)
+            return false;
+        for (size_t i = 0; i < lhs.tapes.size(); ++i) {
+            const TapeView &l = lhs.tapes[i];
+            const TapeView &r = rhs.tapes[i];
+            if (l.left != r.left || l.symbol != r.symbol || l.right != r.right)
+                return false;
+        }
+        return true;
+    }
+};
+
+class TapeStacks {
+  public:
+    size_t push(size_t stack, char symbol) {
+        if (stack == SharedStacks::empty && symbol == '_')
+            return stack;
+        return _stacks.push(stack, symbol);
+    }
+    char top(size_t stack) const {
+        return stack == SharedStacks::empty ? '_' : _stacks.top(stack);
+    }
+    size_t pop(size_t stack) const { return _stacks.pop(stack); }
+    size_t size(size_t stack) const { return _stacks.size(stack); }
+
+    Tape load(const TapeView &view) const {
+        std::string left{};
+        std::string right{};
+        _stacks.collect(view.left, left);
+        _stacks.collect(view.right, right);
+        std::reverse(right.begin(), right.end());
+
+        Tape tape{};
+        tape.init(left + view.symbol + right, left.size(),
+                  view.head - static_cast<int>(left.size()));
+        return tape;
+    }
+
+  private:
+    SharedStacks _stacks{};
+};
+
+} // namespace
+
+Result TMSimulator::run_nondeterministic(const std::string &input) {
+    TapeStacks stacks{};
+
+    Configuration root{_machine->start_state, 0,
+                       std::vector<TapeView>(_machine->tape_number,
+                                             TapeView{SharedStacks::empty, '_',
+                                                      SharedStacks::empty, 0})};
+    if (!input.empty()) {
+        root.tapes[0].symbol = input[0];
+        for (size_t i = input.size() - 1; i > 0; --i)
+            root.tapes[0].right = stacks.push(root.tapes[0].right, input[i]);
+    }
+
+    auto apply = [&stacks](const Configuration &configuration,
+                           const CompiledTM::Transition &transition) {
+        Configuration next{transition.next_state, configuration.depth + 1, configuration.tapes};
+        for (size_t i = 0; i < next.tapes.size(); ++i) {
+            TapeView &tape = next.tapes[i];
+            if (transition.new_str[i] != '*')
+                tape.symbol = transition.new_str[i];
+
+            if (transition.direction[i] == 'l') {
+                tape.right = stacks.push(tape.right, tape.symbol);
+                tape.symbol = stacks.top(tape.left);
+                tape.left = stacks.pop(tape.left);
+                tape.head--;
+            } else if (transition.direction[i] == 'r') {
+                tape.left = stacks.push(tape.left, tape.symbol);
+                tape.symbol = stacks.top(tape.right);
+                tape.right = stacks.pop(tape.right);
+                tape.head++;
+            }
+        }
+        return next;
+    };
+
+    // Iterative deepening may reach a configuration again on a shorter path, which then has
+    // to be explored again
+    bool deepening = _search_strategy == SearchStrategy::IterativeDeepening;
+    std::unordered_map<Configuration, size_t, ConfigurationHash, ConfigurationEqual> visited{};
+    std::deque<Configuration> frontier{};
+    size_t visits = 0;
+    bool pruned = false; // a branch ended in a configuration visited before
+    auto visit = [deepening, &visited, &frontier, &visits, &pruned](Configuration configuration) {
+        auto it = visited.find(configuration);
+        if (it != visited.end()) {
+            if (!deepening || it->second <= configuration.depth) {
+                pruned = true;
+                return;
+            }
+            it->second = configuration.depth;
+        } else {
+            visited.emplace(configuration, configuration.depth);
+        }
+        visits++;
+        frontier.push_back(std::move(configuration));
+    };
+
+    if (_verbose) {
+        std::cout << "Input: " + input << std::endl;
+        std::cout << "==================== RUN ====================" << std::endl;
+    }
+
+    Tape output{}; // first tape of the accepting branch, or else of the first halted one
+    bool halted_branch = false;
+    bool done = false;
+    HaltReason reason = HaltReason::NoTransition;
+    std::string symbols(_machine->tape_number, '_');
+    std::vector<size_t> ids{};
+
+    // A profile counts the branches each rule starts and the configurations explored in each
+    // state, over every round of iterative deepening
+    _stats.tape_cells.assign(_machine->tape_number, 0);
+    if (_profile) {
+        _stats.fires.assign(_machine->transition_count(), 0);
+        _stats.visits.assign(_machine->states.size(), 0);
+    }
+
+    size_t depth_bound = deepening ? 1 : std::numeric_limits<size_t>::max();
+    while (!done) {
+        bool cut = false;
+        pruned = false;
+        visited.clear();
+        frontier.clear();
+        visit(root);
+
+        while (!frontier.empty()) {
+            if (_max_configurations != 0 && visits > _max_configurations) {
+                reason = HaltReason::Limit;
+                done = true;
+                break;
+            }
+
+            Configuration configuration{};
+            if (_search_strategy == SearchStrategy::BreadthFirst) {
+                configuration = std::move(frontier.front());
+                frontier.pop_front();
+            } else {
+                configuration = std::move(frontier.back());
+                frontier.pop_back();
+            }
+            if (deepening && visited[configuration] < configuration.depth)
+                continue; // reached again on a shorter path
+            for (size_t i = 0; i < configuration.tapes.size(); ++i) {
+                const TapeView &tape = configuration.tapes[i];
+                _stats.tape_cells[i] = std::max(_stats.tape_cells[i], stacks.size(tape.left) + 1 +
+                                                                          stacks.size(tape.right));
+            }
+            if (_profile)
+                _stats.visits[configuration.state]++;
+
+            if (_verbose) {
+                _current_state = configuration.state;
+                _tapes.clear();
+                for (const TapeView &tape : configuration.tapes)
+                    _tapes.push_back(stacks.load(tape));
+                print_state();
+            }
+
+            for (size_t i = 0; i < symbols.size(); ++i)
+                symbols[i] = configuration.tapes[i].symbol;
+            _machine->find_transitions(configuration.state, SymbolSeq(symbols), ids);
+
+            if (ids.empty()) { // this branch halts
+                if (_machine->accepting[configuration.state]) {
+                    _accept = true;
+                    output = stacks.load(configuration.tapes[0]);
+                    reason = HaltReason::Accept;
+                    done = true;
+                    break;
+                }
+                if (!halted_branch)
+                    output = stacks.load(configuration.tapes[0]);
+                halted_branch = true;
+                continue;
+            }
+
+            size_t cells = 0;
+            for (const TapeView &tape : configuration.tapes)
+                cells += stacks.size(tape.left) + 1 + stacks.size(tape.right);
+            if (limit_reached(_counter, cells, reason)) {
+                done = true;
+                break;
+            }
+
+            _counter++;
+            if (configuration.depth == depth_bound) {
+                cut = true;
+                continue;
+            }
+
+            // Depth-first search takes the frontier from the back, so push the first rule last
+            if (_profile) {
+                for (size_t id : ids)
+                    _stats.fires[id]++;
+            }
+            if (_search_strategy == SearchStrategy::BreadthFirst) {
+                for (size_t id : ids)
+                    visit(apply(configuration, _machine->transition(id)));
+            } else {
+                for (auto it = ids.rbegin(); it != ids.rend(); ++it)
+                    visit(apply(configuration, _machine->transition(*it)));
+            }
+        }
+
+        done = done || !cut;
+        depth_bound *= 2;
+    }
+
+    // Without a halted branch, the branches that were cut off only ever repeat themselves
+    if (reason == HaltReason::NoTransition && !halted_branch && pruned)
+        reason = HaltReason::Loop;
+
+    if (_profile)
+        name_profile();
+
+    _tapes.assign(1, output);
+    halt(reason);
+
+    return Result{_accept, output.to_string(), _counter, _halt_reason};
+}
+
+} // namespace fla
@@ -1,142 +1,372 @@
 #include <fla/pda.h>
+#include <fla/trace.h>
 
-#include <iomanip>
+#include <algorithm>
 #include <iostream>
+#include <sstream>
 
 namespace fla {
 
-void PDASimulator::run(const std::string &input) {
+Result PDASimulator::run(const std::string &input) {
+    reset();
 
     { // check input
-        for (size_t i = 0; i < input.size(); ++i) {
-            std::string tmp = std::string(1, input[i]);
-
-            if (!_input_alphabet.contains(tmp)) {
-                _error = Error::InputError;
-                _error_logs.push_back("Input: " + input);
-                _error_logs.push_back("==================== ERR ====================");
-                _error_logs.push_back("error: '" + tmp +
-                                      "' was not declared in the set of input symbols");
-                _error_logs.push_back("Input: " + input);
-                _error_logs.push_back(std::string(7 + i, ' ') + std::string(1, '^'));
-                error_handler();
-            }
+        size_t i = _machine->input_alphabet.validate(input);
+        if (i != Alphabet::npos) {
+            _error = Error::InputError;
+            _error_logs.push_back("Input: " + input);
+            _error_logs.push_back("==================== ERR ====================");
+            _error_logs.push_back("error: '" + std::string(1, input[i]) +
+                                  "' was not declared in the set of input symbols");
+            _error_logs.push_back("Input: " + input);
+            _error_logs.push_back(std::string(7 + i, ' ') + std::string(1, '^'));
+            error_handler();
         }
     }
 
-    { // init PDA
-        for (size_t i = 0; i < input.size(); ++i)
-            _input.push(input[i]);
-        _stack.push_back(_stack_start_symbol[0]);
-        _current_state = _start_state;
-    }
+    if (_machine->nondeterministic)
+        return run_nondeterministic(input);
 
     if (_verbose) {
         std::cout << "Input: " + input << std::endl;
         std::cout << "==================== RUN ====================" << std::endl;
     }
 
-    while (true) {
+    InputCursor cursor(input.data(), input.size());
+    _input = &cursor;
+    return run_deterministic(&input);
+}
+
+Result PDASimulator::run(InputCursor &input) {
+    reset();
+
+    Result result{};
+    std::string buffer{};
+    if (_machine->nondeterministic) { // the search needs the whole input
+        for (; !input.empty(); input.pop())
+            buffer.push_back(input.front());
+    } else {
         if (_verbose)
+            std::cout << "==================== RUN ====================" << std::endl;
+        _input = &input;
+        result = run_deterministic(nullptr);
+
+        // The input the machine did not read must still be valid
+        for (; !input.empty(); input.pop()) {
+            if (!_machine->input_alphabet.contains(input.front()))
+                input_error(input.front(), input.position());
+        }
+    }
+
+    if (input.failed()) {
+        _error_logs.push_back("Error: Could not read the input");
+        _error = Error::OtherError;
+        error_handler();
+    }
+    return _machine->nondeterministic ? run(buffer) : result;
+}
+
+Result PDASimulator::run_deterministic(const std::string *input) {
+    _stack.push_back(_machine->stack_start_symbol);
+    if (_trace) {
+        _trace->run('P', _machine->states);
+        _trace->byte(input != nullptr);
+        if (input)
+            _trace->string(*input);
+        _trace->byte(_machine->stack_start_symbol);
+        _trace->size(_current_state);
+    }
+
+    _stats.max_stack = _stack.size();
+    if (_profile)
+        _stats.fires.assign(_machine->actions.size(), 0);
+
+    bool ring = _verbose && _filter.ring != 0;
+    if (_verbose)
+        start_filter(_machine->states);
+    if (ring)
+        _ring.assign(_filter.ring, Undo{});
+
+    HaltReason limit = HaltReason::Limit;
+    while (!_halted) {
+        if (ring)
+            _ring[_counter % _ring.size()] =
+                Undo{_current_state, _stack.size(), _stack.empty() ? '_' : _stack.back()};
+        else if (_verbose && selected(_counter, _current_state))
             print_state();
 
-        if (_input.empty() && _accept_states.find(_current_state) != _accept_states.end()) {
+        if (_input->empty() && _machine->accepting[_current_state]) {
             _accept = true;
-            halt();
+            halt(HaltReason::Accept);
+        } else if (_stack.empty()) {
+            halt(HaltReason::EmptyStack);
+        } else if (limit_reached(_counter, _stack.size(), limit)) {
+            halt(limit);
+        } else if (_detect_cycles && in_epsilon_cycle()) {
+            halt(HaltReason::Loop);
+        } else if (!step()) {
+            halt(HaltReason::NoTransition);
+        } else {
+            _counter++;
         }
+    }
+    _input = nullptr;
+    if (_trace) {
+        _trace->byte(trace_end);
+        _trace->byte(_accept);
+    }
+    if (_profile) { // a step leaves the state of its rule
+        name_profile();
+        _stats.visits.assign(_machine->states.size(), 0);
+        _stats.visits[_current_state]++;
+        for (size_t i = 0; i < _stats.fires.size(); ++i)
+            _stats.visits[_rule_states[i]] += _stats.fires[i];
+    }
+
+    return Result{_accept, _accept ? "true" : "false", _counter, _halt_reason};
+}
+
+void PDASimulator::reset() noexcept {
+    Simulator::reset();
+
+    _counter = 0;
+    _input = nullptr;
+    _stack.clear();
+    _current_state = _machine ? _machine->start_state : 0;
+    _accept = false;
+    _ring.clear();
+
+    drop_epsilon_levels(0);
+    if (_detect_cycles && _machine)
+        _epsilon_key_count.assign(_machine->states.size() * _machine->stack_alphabet.size(), 0);
+}
+
+std::unique_ptr<Simulator> PDASimulator::clone() const {
+    auto simulator = std::make_unique<PDASimulator>();
+    simulator->Simulator::operator=(*this); // settings
+    simulator->_machine = _machine;
+    simulator->reset();
+    return simulator;
+}
+
+bool PDASimulator::step() {
+    char stack_top = _stack.back();
+    _stack.pop_back();
 
-        if (_stack.empty())
-            halt();
+    auto actions = _machine->find_transitions(_current_state, '_', stack_top);
 
-        step();
-        _counter++;
+    char input_char = '_';
+    if (actions.first == actions.second && !_input->empty()) {
+        input_char = _input->front();
+        if (!_machine->input_alphabet.contains(input_char))
+            input_error(input_char, _input->position());
+        _input->pop();
+
+        actions = _machine->find_transitions(_current_state, input_char, stack_top);
+    }
+
+    if (actions.first == actions.second) { // the configuration stays as it was printed
+        _stack.push_back(stack_top);
+        return false;
+    }
+
+    const CompiledPDA::Action &action = _machine->actions[actions.first];
+    _current_state = action.next_state;
+    const char *push = _machine->pushes.data() + action.push;
+    _stack.insert(_stack.end(), push, push + action.push_size);
+    _stats.max_stack = std::max(_stats.max_stack, _stack.size());
+    if (_profile)
+        _stats.fires[actions.first]++;
+    if (_trace) {
+        _trace->byte(trace_step);
+        _trace->size(_current_state);
+        _trace->byte(input_char);
+        _trace->size(action.push_size);
+        _trace->bytes(push, action.push_size);
     }
+    return true;
 }
 
-void PDASimulator::step() {
-    char stack_top;
-    stack_top = _stack[_stack.size() - 1];
-    _stack.erase(_stack.end() - 1);
+void PDASimulator::name_profile() {
+    const CompiledPDA &machine = *_machine;
+    std::string input_symbols = machine.input_alphabet.symbols();
+    std::string stack_symbols = machine.stack_alphabet.symbols();
+    _stats.states.clear();
+    for (size_t i = 0; i < machine.states.size(); ++i)
+        _stats.states.push_back(machine.states.name(i));
 
-    std::string push_chars{};
-    State next_state{};
-    Condition current_condition{};
-    std::map<Condition, Action>::iterator it;
+    // The actions are grouped by the slot of their condition, see compile()
+    const std::vector<size_t> &offsets = machine.transition_offsets;
+    _stats.rules.clear();
+    _rule_states.clear();
+    for (size_t i = 0; i < machine.actions.size(); ++i) {
+        size_t slot = static_cast<size_t>(
+            std::upper_bound(offsets.begin(), offsets.end(), i) - offsets.begin() - 1);
+        size_t top = slot % stack_symbols.size();
+        size_t input = slot / stack_symbols.size() % (input_symbols.size() + 1);
+        size_t state = slot / stack_symbols.size() / (input_symbols.size() + 1);
 
-    current_condition = std::make_tuple(_current_state, '_', stack_top);
-    it = _transitions.find(current_condition);
-    if (it != _transitions.end()) {
-        next_state = std::get<0>(it->second);
-        push_chars = std::get<1>(it->second);
+        const CompiledPDA::Action &action = machine.actions[i];
+        _stats.rules.push_back(machine.states.name(state) + ' ' +
+                               (input == 0 ? '_' : input_symbols[input - 1]) + ' ' +
+                               stack_symbols[top] + ' ' + machine.push_string(action) + ' ' +
+                               machine.states.name(action.next_state));
+        _rule_states.push_back(state);
     }
+}
 
-    if (push_chars.empty() && !_input.empty()) {
-        char input_char = _input.front();
-        _input.pop();
+void PDASimulator::input_error(char c, size_t position) {
+    _input = nullptr;
+    _error = Error::InputError;
+    _error_logs.push_back("==================== ERR ====================");
+    _error_logs.push_back("error: '" + std::string(1, c) +
+                          "' was not declared in the set of input symbols");
+    _error_logs.push_back("at offset " + std::to_string(position) + " of the input");
+    error_handler();
+}
 
-        current_condition = std::make_tuple(_current_state, input_char, stack_top);
-        it = _transitions.find(current_condition);
-        if (it != _transitions.end()) {
-            next_state = std::get<0>(it->second);
-            push_chars = std::get<1>(it->second);
-        }
+bool PDASimulator::in_epsilon_cycle() {
+    char stack_top = _stack.back();
+    auto actions = _machine->find_transitions(_current_state, '_', stack_top);
+    if (actions.first == actions.second) { // the next move reads input
+        drop_epsilon_levels(0);
+        return false;
     }
 
-    if (push_chars.empty())
-        halt();
+    // ε-moves never look at the input, so the moves since the last visit repeat forever
+    size_t height = _stack.size();
+    drop_epsilon_levels(height + 1);
+    size_t key =
+        _current_state * _machine->stack_alphabet.size() + _machine->stack_alphabet.id(stack_top);
+    if (_epsilon_key_count[key] != 0)
+        return true;
 
-    _current_state = next_state;
-    if (push_chars != "_") {
-        std::reverse(push_chars.begin(), push_chars.end());
-        std::copy(push_chars.begin(), push_chars.end(), std::back_inserter(_stack));
+    if (_epsilon_levels.size() <= height)
+        _epsilon_levels.resize(height + 1);
+    _epsilon_levels[height].push_back(key);
+    _epsilon_key_count[key]++;
+    _epsilon_live = height + 1;
+    return false;
+}
+
+void PDASimulator::drop_epsilon_levels(size_t levels) noexcept {
+    for (; _epsilon_live > levels; --_epsilon_live) {
+        for (size_t key : _epsilon_levels[_epsilon_live - 1])
+            _epsilon_key_count[key]--;
+        _epsilon_levels[_epsilon_live - 1].clear();
     }
 }
 
-void PDASimulator::halt() noexcept {
+std::pair<size_t, size_t> CompiledPDA::find_transitions(size_t state, char input_char,
+                                                        char stack_top) const {
+    size_t stack_top_id = stack_alphabet.id(stack_top);
+    if (stack_top_id == Alphabet::npos) // #z0 is not required to be in #G
+        return std::make_pair(0, 0);
+
+    size_t input_slot = input_char == '_' ? 0 : input_alphabet.id(input_char) + 1;
+    size_t slot = (state * (input_alphabet.size() + 1) + input_slot) * stack_alphabet.size() +
+                  stack_top_id;
+    return std::make_pair(transition_offsets[slot], transition_offsets[slot + 1]);
+}
+
+CompiledPDA::Action CompiledPDA::make_action(size_t next_state, const std::string &push) {
+    Action action{next_state, pushes.size(), 0};
+    if (push != "_") {
+        pushes.append(push.rbegin(), push.rend());
+        action.push_size = push.size();
+    }
+    return action;
+}
+
+std::string CompiledPDA::push_string(const Action &action) const {
+    if (action.push_size == 0)
+        return "_";
+    std::string push = pushes.substr(action.push, action.push_size);
+    return std::string(push.rbegin(), push.rend());
+}
+
+void PDASimulator::halt(HaltReason reason) noexcept {
+    Simulator::halt(reason);
+
     if (_verbose) {
+        if (!_ring.empty())
+            print_ring();
         std::clog << "Halted after " << _counter << " steps." << std::endl;
         std::cout << "Result: " << std::boolalpha << _accept << std::endl;
         std::cout << "==================== END ====================" << std::endl;
-    } else
-        std::cout << std::boolalpha << _accept << std::endl;
+    }
+}
 
-    exit(EXIT_SUCCESS);
+void PDASimulator::print_state() const noexcept {
+    print_step(std::cout, _counter, _machine->states.name(_current_state), _stack);
 }
 
-void PDASimulator::print_stack() const noexcept {
-    int width = 6;
-    std::cout << std::left << std::setw(width) << "Index" << ": ";
-    for (size_t i = 0; i < _stack.size(); i++)
-        std::cout << i << ' ';
-    std::cout << std::endl;
+void PDASimulator::print_ring() {
+    // Undo the kept steps on a copy of the configuration, from the last one back
+    size_t count = std::min(_ring.size(), _counter + 1);
+    size_t state = _current_state;
+    std::vector<char> stack(_stack);
+    std::vector<std::string> blocks(count);
+    std::vector<size_t> states(count);
+    for (size_t i = count; i-- > 0;) {
+        std::ostringstream block{};
+        print_step(block, _counter - (count - 1 - i), _machine->states.name(state), stack);
+        blocks[i] = block.str();
+        states[i] = state;
+        if (i == 0)
+            break;
 
-    std::cout << std::left << std::setw(width) << "Stack" << ": ";
-    for (size_t i = 0; i < _stack.size(); i++)
-        std::cout << std::left << std::setw(static_cast<int>(std::to_string(i).size())) << _stack[i]
-                  << ' ';
-    std::cout << std::endl;
+        const Undo &undo = _ring[(_counter - (count - i)) % _ring.size()];
+        stack.resize(undo.size - 1);
+        stack.push_back(undo.top);
+        state = undo.state;
+    }
 
-    std::cout << std::left << std::setw(width) << "Head" << ": ";
-    for (size_t i = 0; i < _stack.size(); i++)
-        std::cout << std::left << std::setw(static_cast<int>(std::to_string(i).size()))
-                  << (i == _stack.size() - 1 ? "^"
-                                             : std::string(std::to_string(i).size() + 1, ' '));
-    std::cout << std::endl;
+    start_filter(_machine->states);
+    for (size_t i = 0; i < count; ++i) {
+        if (selected(_counter - (count - 1 - i), states[i]))
+            std::cout << blocks[i];
+    }
 }
 
-void PDASimulator::print_state() const noexcept {
-    int width = 6;
-    std::cout << std::left << std::setw(width) << "Step" << ": " << _counter << std::endl;
-    std::cout << std::left << std::setw(width) << "State" << ": " << _current_state.name()
-              << std::endl;
-    if (_stack.empty()) {
-        std::cout << std::left << std::setw(width) << "Index" << ": 0" << std::endl;
-        std::cout << std::left << std::setw(width) << "Stack" << ": _" << std::endl;
-        std::cout << std::left << std::setw(width) << "Head" << ": ^" << std::endl;
-    } else {
-        print_stack();
+void PDASimulator::print_step(std::ostream &out, size_t step, const std::string &state,
+                              const std::vector<char> &stack) {
+    const size_t width = 6;
+    std::string index{};
+    std::string symbols{};
+    std::string head{};
+    append_padded(index, "Index", width);
+    append_padded(symbols, "Stack", width);
+    append_padded(head, "Head", width);
+    if (stack.empty()) {
+        index += ": 0";
+        symbols += ": _";
+        head += ": ^";
+    } else { // every symbol takes as many columns as its index
+        index += ": ";
+        symbols += ": ";
+        head += ": ";
+        for (size_t i = 0; i < stack.size(); i++) {
+            index += std::to_string(i);
+            index += ' ';
+            symbols += stack[i];
+            symbols.append(digits(i), ' ');
+            if (i + 1 == stack.size()) {
+                head += '^';
+                head.append(digits(i) - 1, ' ');
+            } else {
+                head.append(digits(i) + 1, ' ');
+            }
+        }
     }
-    std::cout << "---------------------------------------------" << std::endl;
+
+    std::string lines{};
+    append_padded(lines, "Step", width);
+    lines += ": " + std::to_string(step) + '\n';
+    append_padded(lines, "State", width);
+    lines += ": " + state + '\n';
+    out << lines << index << '\n' << symbols << '\n' << head << '\n'
+        << "---------------------------------------------\n";
 }
 
 } // namespace fla
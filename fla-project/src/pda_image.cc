@@ -0,0 +1,78 @@
+#include <fla/image.h>
+#include <fla/pda.h>
+
+namespace fla {
+
+void PDASimulator::save(const std::string &filepath) {
+    const CompiledPDA &machine = *_machine;
+    ImageWriter image('P');
+
+    image.byte(machine.nondeterministic);
+    image.u64(machine.states.size());
+    for (size_t i = 0; i < machine.states.size(); ++i)
+        image.string(machine.states.name(i));
+    image.string(machine.input_alphabet.symbols());
+    image.string(machine.stack_alphabet.symbols());
+    image.byte(machine.stack_start_symbol);
+    image.u64(machine.start_state);
+    for (bool accepting : machine.accepting)
+        image.byte(accepting);
+
+    image.u64(machine.transition_offsets.size());
+    for (size_t offset : machine.transition_offsets)
+        image.u64(offset);
+    image.u64(machine.actions.size());
+    for (const CompiledPDA::Action &action : machine.actions) {
+        image.u64(action.next_state);
+        image.string(machine.push_string(action));
+    }
+
+    write_image(filepath, image);
+}
+
+void PDASimulator::load(const std::string &filepath) {
+    auto machine = std::make_shared<CompiledPDA>();
+
+    read_image(filepath, 'P', [&machine](ImageReader &image) {
+        machine->nondeterministic = image.byte() != 0;
+        size_t states = image.size();
+        for (size_t i = 0; i < states; ++i) {
+            if (machine->states.intern(image.string()) != i)
+                return false;
+        }
+        for (char c : image.string())
+            machine->input_alphabet.add(std::string(1, c));
+        for (char c : image.string())
+            machine->stack_alphabet.add(std::string(1, c));
+        machine->stack_start_symbol = image.byte();
+        machine->start_state = image.size();
+        for (size_t i = 0; i < states; ++i)
+            machine->accepting.push_back(image.byte() != 0);
+
+        // Only the structure is checked, the machine was validated when it was compiled
+        size_t offsets = image.size();
+        if (offsets != states * (machine->input_alphabet.size() + 1) *
+                               machine->stack_alphabet.size() + 1)
+            return false;
+        for (size_t i = 0; i < offsets; ++i) {
+            machine->transition_offsets.push_back(image.size());
+            if (i > 0 && machine->transition_offsets[i] < machine->transition_offsets[i - 1])
+                return false;
+        }
+        size_t actions = image.size();
+        if (machine->transition_offsets.back() != actions)
+            return false;
+        for (size_t i = 0; i < actions; ++i) {
+            size_t next_state = image.size();
+            if (next_state >= states)
+                return false;
+            machine->actions.push_back(machine->make_action(next_state, image.string()));
+        }
+        return machine->start_state < states;
+    });
+
+    _nondeterministic = machine->nondeterministic;
+    _machine = machine;
+}
+
+} // namespace fla
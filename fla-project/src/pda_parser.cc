@@ -1,55 +1,37 @@
 #include <fla/pda.h>
+#include <fla/source.h>
 
-#include <fstream>
-#include <regex>
+#include <numeric>
+#include <sstream>
+#include <tuple>
 
 namespace fla {
 
 void PDASimulator::parse(const std::string &filepath) {
-    std::ifstream fin(filepath);
+    SourceFile source(filepath);
 
-    if (!fin.is_open()) {
+    if (!source.is_open()) {
         _error_logs.push_back("Error: Could not open the file: " + filepath);
         _error = Error::OtherError;
         error_handler();
     }
 
-    // init parse_handlers
-    std::vector<std::pair<std::regex, std::function<void(const std::string &)>>> parse_handlers = {
-        {
-            std::regex(R"(#Q = \{([^}]+)\})"),
-            [this](const std::string &line) -> void { this->parse_states(line); },
-        },
-        {
-            std::regex(R"(#S = \{([^}]+)\})"),
-            [this](const std::string &line) -> void { this->parse_input_alphabet(line); },
-        },
-        {
-            std::regex(R"(#G = \{([^}]+)\})"),
-            [this](const std::string &line) -> void { this->parse_stack_alphabet(line); },
-        },
-        {
-            std::regex(R"(#q0 = ([^ ]+))"),
-            [this](const std::string &line) -> void { this->parse_start_state(line); },
-        },
-        {
-            std::regex(R"(#z0 = ([^ ]+))"),
-            [this](const std::string &line) -> void { this->parse_stack_start_symbol(line); },
-        },
-        {
-            std::regex(R"(#F = \{([^}]+)\})"),
-            [this](const std::string &line) -> void { this->parse_accept_states(line); },
-        },
-        {
-            std::regex(R"(([^#{}]+))"),
-            [this](const std::string &line) -> void { this->parse_transitions(line); },
-        },
+    // Lines that are not directives are transitions
+    using Handler = void (PDASimulator::*)(const std::string &);
+    const std::vector<std::tuple<std::string, bool, Handler>> directives = {
+        std::make_tuple("#Q", true, &PDASimulator::parse_states),
+        std::make_tuple("#S", true, &PDASimulator::parse_input_alphabet),
+        std::make_tuple("#G", true, &PDASimulator::parse_stack_alphabet),
+        std::make_tuple("#q0", false, &PDASimulator::parse_start_state),
+        std::make_tuple("#z0", false, &PDASimulator::parse_stack_start_symbol),
+        std::make_tuple("#F", true, &PDASimulator::parse_accept_states),
     };
 
     std::string line;
+    std::string value;
     size_t line_number = 0;
 
-    while (std::getline(fin, line)) {
+    while (source.next_line(line)) {
         line_number++;
 
         ignore_after(line, ';');
@@ -59,16 +41,17 @@ void PDASimulator::parse(const std::string &filepath) {
             continue;
 
         bool matched = false;
-        for (const auto &handler : parse_handlers) {
-            std::smatch match;
-            if (std::regex_match(line, match, handler.first)) {
-                handler.second(match[1]);
+        for (const auto &directive : directives) {
+            if (match_directive(line, std::get<0>(directive), std::get<1>(directive), value)) {
+                (this->*std::get<2>(directive))(value);
                 matched = true;
                 break;
             }
         }
 
-        if (!matched) {
+        if (!matched && line.find_first_of("#{}") == std::string::npos) {
+            parse_transitions(line);
+        } else if (!matched) {
             _error_logs.push_back("Invalid transition format");
             _error = Error::SyntaxError;
         }
@@ -101,12 +84,13 @@ void PDASimulator::parse(const std::string &filepath) {
         if (_transitions.empty())
             _error_logs.push_back("No transitions defined");
 
+        // A NPDA may choose between reading the input and an empty input transition
         for (const auto &transition : _transitions) {
             const auto &from_state = std::get<0>(transition.first);
             const auto &input_char = std::get<1>(transition.first);
             const auto &stack_top = std::get<2>(transition.first);
 
-            if (input_char != '_') {
+            if (input_char != '_' && !_nondeterministic) {
                 Condition empty_input_condition = std::make_tuple(from_state, '_', stack_top);
                 if (_transitions.find(empty_input_condition) != _transitions.end()) {
                     _error_logs.push_back("Duplicate transition condition:");
@@ -121,6 +105,8 @@ void PDASimulator::parse(const std::string &filepath) {
             error_handler();
         }
     }
+
+    compile();
 }
 
 void PDASimulator::parse_states(const std::string &line) {
@@ -133,7 +119,7 @@ void PDASimulator::parse_states(const std::string &line) {
             _error_logs.push_back("Invalid state name: " + tmp);
             return;
         }
-        _states.insert(State(tmp));
+        _states.intern(tmp);
     }
 }
 
@@ -200,12 +186,8 @@ void PDASimulator::parse_accept_states(const std::string &line) {
 }
 
 void PDASimulator::parse_transitions(const std::string &line) {
-    std::stringstream ss(line);
-    std::string item;
     std::vector<std::string> elements;
-
-    while (ss >> item)
-        elements.push_back(item);
+    split_whitespace(line, elements);
 
     if (elements.size() != 5) {
         _error_logs.push_back("Invalid format");
@@ -220,7 +202,7 @@ void PDASimulator::parse_transitions(const std::string &line) {
     const std::string &stack_push = elements[4];
 
     { // check transition grammar
-        if (_states.find(State(from_state)) == _states.end())
+        if (_states.find(from_state) == SymbolTable::npos)
             _error_logs.push_back("Invalid from state name: " + from_state);
 
         if (input_char != "_" &&
@@ -230,12 +212,12 @@ void PDASimulator::parse_transitions(const std::string &line) {
         if (!_stack_alphabet.contains(stack_top)) // The stack top can not be empty
             _error_logs.push_back("Invalid stack top symbol: " + stack_top);
 
-        if (_states.find(State(to_state)) == _states.end())
+        if (_states.find(to_state) == SymbolTable::npos)
             _error_logs.push_back("Invalid to state name: " + to_state);
 
         if (stack_push != "_") { // The stack push string can be empty
             for (char c : stack_push) {
-                if (!_stack_alphabet.contains(std::string(1, c))) {
+                if (!_stack_alphabet.contains(c)) {
                     _error_logs.push_back("Invalid stack push symbol: " + stack_push);
                     break;
                 }
@@ -251,13 +233,61 @@ void PDASimulator::parse_transitions(const std::string &line) {
     Condition condition = std::make_tuple(State(from_state), input_char[0], stack_top[0]);
     Action action = std::make_tuple(State(to_state), stack_push);
 
-    if (_transitions.find(condition) != _transitions.end()) {
+    if (!_nondeterministic && _transitions.find(condition) != _transitions.end()) {
         _error_logs.push_back("Duplicate transition condition");
         _error = Error::SyntaxError;
         return;
     }
 
-    _transitions[condition] = action;
+    _transitions.emplace(condition, action);
+}
+
+void PDASimulator::compile() {
+    auto machine = std::make_shared<CompiledPDA>();
+    machine->states = _states;
+    machine->input_alphabet = _input_alphabet;
+    machine->stack_alphabet = _stack_alphabet;
+    machine->stack_start_symbol = _stack_start_symbol[0];
+
+    // The start and accept states are not required to be in #Q
+    SymbolTable &states = machine->states;
+    machine->start_state = states.intern(_start_state.name());
+    std::vector<size_t> accept_ids{};
+    for (const State &state : _accept_states)
+        accept_ids.push_back(states.intern(state.name()));
+
+    machine->accepting.assign(states.size(), false);
+    for (size_t id : accept_ids)
+        machine->accepting[id] = true;
+
+    // Input slot 0 is reserved for the empty input '_'
+    auto slot_of = [this](size_t state, char input_char, char stack_top) -> size_t {
+        size_t input_slot = input_char == '_' ? 0 : _input_alphabet.id(input_char) + 1;
+        return (state * (_input_alphabet.size() + 1) + input_slot) * _stack_alphabet.size() +
+               _stack_alphabet.id(stack_top);
+    };
+
+    // Group the actions by condition, the multimap keeps equal conditions in file order
+    std::vector<size_t> &offsets = machine->transition_offsets;
+    offsets.assign(states.size() * (_input_alphabet.size() + 1) * _stack_alphabet.size() + 1, 0);
+    std::vector<size_t> slots{};
+    for (const auto &transition : _transitions) {
+        slots.push_back(slot_of(states.find(std::get<0>(transition.first).name()),
+                                std::get<1>(transition.first), std::get<2>(transition.first)));
+        offsets[slots.back() + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    machine->actions.resize(_transitions.size());
+    size_t i = 0;
+    for (const auto &transition : _transitions) {
+        machine->actions[next[slots[i++]]++] = machine->make_action(
+            states.find(std::get<0>(transition.second).name()), std::get<1>(transition.second));
+    }
+    machine->nondeterministic = _nondeterministic;
+
+    _machine = machine;
 }
 
 } // namespace fla
@@ -1,22 +1,84 @@
+#include <fla/image.h>
 #include <fla/simulator.h>
+#include <fla/source.h>
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-#include <regex>
 #include <string>
 
 namespace fla {
 
-bool State::is_valid(std::string name) {
-    std::regex stateNameRegex("^[a-zA-Z0-9_]+$");
-    return std::regex_match(name, stateNameRegex);
+bool State::is_valid(const std::string &name) {
+    auto valid = [](char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+               c == '_';
+    };
+    return !name.empty() && std::all_of(name.begin(), name.end(), valid);
 }
 
-bool Alphabet::is_valid(std::string s) {
+constexpr size_t SymbolTable::npos;
+constexpr size_t Alphabet::npos;
+
+size_t SymbolTable::intern(const std::string &name) {
+    auto it = _ids.find(name);
+    if (it != _ids.end())
+        return it->second;
+
+    _ids.emplace(name, _names.size());
+    _names.push_back(name);
+    return _names.size() - 1;
+}
+
+size_t SymbolTable::find(const std::string &name) const {
+    auto it = _ids.find(name);
+    return it == _ids.end() ? npos : it->second;
+}
+
+bool Alphabet::is_valid(const std::string &s) {
     if (s.size() != 1) {
         return false;
     }
-    std::set<char> invalidChars = {' ', ',', ';', '{', '}', '*', '_'};
-    return std::isprint(s[0]) && invalidChars.find(s[0]) == invalidChars.end();
+    return std::isprint(static_cast<unsigned char>(s[0])) && !std::strchr(" ,;{}*_", s[0]);
+}
+
+void Alphabet::add(std::string s) {
+    if (s.size() != 1 || contains(s[0]))
+        return;
+    unsigned char symbol = static_cast<unsigned char>(s[0]);
+    _members[symbol >> 6] |= uint64_t{1} << (symbol & 63);
+    _ids[symbol] = ++_size;
+}
+
+size_t Alphabet::validate(const char *input, size_t size) const {
+    // Blocks are checked without branches and only searched once one of them fails
+    const size_t block = 64;
+    for (size_t begin = 0; begin < size; begin += block) {
+        size_t end = std::min(size, begin + block);
+        uint64_t missing = 0;
+        for (size_t i = begin; i < end; ++i) {
+            unsigned char symbol = static_cast<unsigned char>(input[i]);
+            missing |= ~(_members[symbol >> 6] >> (symbol & 63)) & 1;
+        }
+        if (missing == 0)
+            continue;
+
+        for (size_t i = begin; i < end; ++i) {
+            if (!contains(input[i]))
+                return i;
+        }
+    }
+    return npos;
+}
+
+std::string Alphabet::symbols() const {
+    std::string symbols(size(), '\0');
+    for (size_t c = 0; c < _ids.size(); ++c) {
+        if (_ids[c] != 0)
+            symbols[_ids[c] - 1] = static_cast<char>(c);
+    }
+    return symbols;
 }
 
 void Simulator::set_verbose(bool verbose) noexcept {
@@ -25,9 +87,98 @@ void Simulator::set_verbose(bool verbose) noexcept {
 }
 
 void Simulator::reset() noexcept {
-    _verbose = false;
     _error = Error::None;
     _error_logs.clear();
+    _halted = false;
+    _halt_reason = HaltReason::NoTransition;
+    _stats = RunStats{};
+    _deadline = std::chrono::steady_clock::now() + _timeout;
+}
+
+void Simulator::write_image(const std::string &filepath, const ImageWriter &image) {
+    std::ofstream fout(filepath, std::ios::binary);
+    fout.write(image.data().data(), static_cast<std::streamsize>(image.data().size()));
+    if (!fout) {
+        _error_logs.push_back("Error: Could not write the file: " + filepath);
+        _error = Error::OtherError;
+        error_handler();
+    }
+}
+
+void Simulator::read_image(const std::string &filepath, char kind,
+                           const std::function<bool(ImageReader &)> &read) {
+    SourceFile source(filepath);
+    if (!source.is_open()) {
+        _error_logs.push_back("Error: Could not open the file: " + filepath);
+        _error = Error::OtherError;
+        error_handler();
+    }
+
+    bool valid = false;
+    try {
+        ImageReader image(source.data(), source.size());
+        valid = image.header(kind) && read(image) && image.done();
+    } catch (const std::out_of_range &) {
+        valid = false;
+    }
+
+    if (!valid) {
+        _error_logs.push_back("Error: Invalid compiled machine: " + filepath);
+        _error = Error::OtherError;
+        error_handler();
+    }
+}
+
+bool Simulator::limit_reached(size_t steps, size_t cells, HaltReason &reason) const noexcept {
+    if ((_max_steps != 0 && steps >= _max_steps) || (_max_cells != 0 && cells > _max_cells)) {
+        reason = HaltReason::Limit;
+        return true;
+    }
+
+    // Reading the clock costs more than a step, so it is only read every 1024 steps
+    if (_timeout.count() != 0 && steps % 1024 == 0 && timed_out()) {
+        reason = HaltReason::Timeout;
+        return true;
+    }
+
+    return false;
+}
+
+bool Simulator::timed_out() const noexcept {
+    return _timeout.count() != 0 && std::chrono::steady_clock::now() >= _deadline;
+}
+
+void Simulator::start_filter(const SymbolTable &states) {
+    _next_print = _filter.first;
+    _previous_state = SymbolTable::npos;
+    _entered.clear();
+    if (_filter.states.empty())
+        return;
+    _entered.assign(std::max<size_t>(states.size(), 1), false);
+    for (const std::string &name : _filter.states) {
+        size_t id = states.find(name);
+        if (id != SymbolTable::npos)
+            _entered[id] = true;
+    }
+}
+
+bool Simulator::select(size_t step, size_t state) noexcept {
+    bool entered = true;
+    if (!_entered.empty()) {
+        entered = _entered[state] && state != _previous_state;
+        _previous_state = state;
+    }
+    if (step < _next_print)
+        return false;
+    if (_filter.last != 0 && step > _filter.last) {
+        _next_print = static_cast<size_t>(-1);
+        return false;
+    }
+
+    size_t every = std::max<size_t>(_filter.every, 1);
+    size_t offset = (step - _filter.first) % every;
+    _next_print = step + every - offset;
+    return offset == 0 && entered;
 }
 
 void Simulator::error_handler() {
@@ -36,16 +187,17 @@ void Simulator::error_handler() {
 
     if (!_verbose) {
         switch (_error) {
-        case Error::SyntaxError:
-            std::cerr << "syntax error" << std::endl;
+        case Error::SyntaxError: // single writes, batch workers may report concurrently
+            std::cerr << "syntax error\n";
             break;
         case Error::InputError:
-            std::cerr << "illegal input" << std::endl;
+            std::cerr << "illegal input\n";
             break;
         default:
             break;
         }
     } else {
+        std::cout.flush(); // the trace comes before the errors
         std::clog << "Error logs:" << std::endl;
         for (const std::string &error : _error_logs) {
             std::cerr << error << std::endl;
@@ -0,0 +1,69 @@
+#include <fla/source.h>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FLA_HAS_MMAP 1
+#endif
+
+namespace fla {
+
+SourceFile::SourceFile(const std::string &filepath) {
+#ifdef FLA_HAS_MMAP
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat info {};
+    if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *data = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE,
+                            fd, 0);
+        if (data != MAP_FAILED) {
+            _data = static_cast<const char *>(data);
+            _size = static_cast<size_t>(info.st_size);
+            _mapped = true;
+        }
+    }
+    ::close(fd);
+#endif
+
+    if (!_mapped) { // empty files, pipes and platforms without mmap
+        std::ifstream fin(filepath, std::ios::binary);
+        if (!fin.is_open())
+            return;
+        std::ostringstream contents;
+        contents << fin.rdbuf();
+        _buffer = contents.str();
+        _data = _buffer.data();
+        _size = _buffer.size();
+    }
+    _open = true;
+}
+
+SourceFile::~SourceFile() {
+#ifdef FLA_HAS_MMAP
+    if (_mapped)
+        ::munmap(const_cast<char *>(_data), _size);
+#endif
+}
+
+bool SourceFile::next_line(std::string &line) {
+    if (_offset >= _size)
+        return false;
+
+    const char *begin = _data + _offset;
+    const void *newline = std::memchr(begin, '\n', _size - _offset);
+    size_t length = newline ? static_cast<size_t>(static_cast<const char *>(newline) - begin)
+                            : _size - _offset;
+    line.assign(begin, length);
+    _offset += length + 1;
+    return true;
+}
+
+} // namespace fla
@@ -1,8 +1,11 @@
 #include <cstddef>
 #include <fla/tm.h>
+#include <fla/trace.h>
 
-#include <iomanip>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <tuple>
 
@@ -23,174 +26,604 @@ bool SymbolSeq::operator==(const SymbolSeq &rhs) const {
     return true;
 }
 
-void Tape::step(char symbol, char direction) {
-    if (symbol != '*') {
-        _tape[static_cast<size_t>(_head)] = symbol;
-    }
+void Tape::init(const std::string &input) { init(input, 0, 0); }
 
-    switch (direction) {
-    case 'l':
-        _head--;
-        break;
-    case 'r':
-        _head++;
-        break;
-    default:
-        break;
-    }
+void Tape::init(const std::string &cells, size_t head, int first) {
+    _cells.assign(cells.begin(), cells.end());
+    if (_cells.empty())
+        _cells.push_back('_');
+    _origin = -first;
+    _head = head;
+    _low = 0;
+    _high = _cells.size() - 1;
 
-    expand();
-    shrink();
+    _hash = 0;
+    for (size_t i = 0; i < _cells.size(); ++i)
+        _hash += cell_hash(position(i), _cells[i]);
 }
 
-void Tape::expand() {
-    if (_head < 0) {
-        _tape.push_front('_');
-        _offset--;
-        _head = 0;
-    }
+void Tape::grow_left() {
+    size_t extra = _cells.size();
+    _cells.insert(_cells.begin(), extra, '_');
+    _origin += static_cast<int>(extra);
+    _head += extra;
+    _low += extra;
+    _high += extra;
+}
 
-    if (_head >= static_cast<int>(_tape.size())) {
-        _tape.push_back('_');
-    }
+char Tape::at(int position) const {
+    int index = position + _origin;
+    if (index < static_cast<int>(_low) || index > static_cast<int>(_high))
+        return '_';
+    return _cells[static_cast<size_t>(index)];
 }
 
-void Tape::shrink() {
-    if (_head > 0 && _tape.front() == '_') {
-        _tape.pop_front();
-        _head--;
-        _offset++;
-    }
+bool Tape::operator==(const Tape &rhs) const {
+    if (_hash != rhs._hash || position(_head) != rhs.position(rhs._head))
+        return false;
 
-    if (_head < static_cast<int>(_tape.size()) - 1 && _tape.back() == '_') {
-        _tape.pop_back();
+    int first = std::min(position(_low), rhs.position(rhs._low));
+    int last = std::max(position(_high), rhs.position(rhs._high));
+    for (int i = first; i <= last; ++i) {
+        if (at(i) != rhs.at(i))
+            return false;
     }
+    return true;
 }
 
-std::string Tape::to_string() {
-    std::string tmp{};
-    std::copy(_tape.begin(), _tape.end(), std::back_inserter(tmp));
-    while (tmp.front() == '_') {
-        tmp.erase(tmp.begin());
-    }
+void Tape::grow_right() { _cells.resize(_cells.size() * 2, '_'); }
 
-    while (tmp.back() == '_') {
-        tmp.pop_back();
-    }
+void Tape::read_block(int first, size_t size, std::string &block) const {
+    for (size_t i = 0; i < size; ++i)
+        block.push_back(at(first + static_cast<int>(i)));
+}
 
-    return tmp;
+void Tape::write_block(int first, const std::string &block, int low, int high, int head) {
+    while (std::min(first, low) + _origin < 0)
+        grow_left();
+    while (std::max(first + static_cast<int>(block.size()) - 1, high) + _origin >=
+           static_cast<int>(_cells.size()))
+        grow_right();
+
+    for (size_t i = 0; i < block.size(); ++i)
+        write(static_cast<size_t>(first + _origin) + i, block[i]);
+    _low = std::min(_low, static_cast<size_t>(low + _origin));
+    _high = std::max(_high, static_cast<size_t>(high + _origin));
+    _head = static_cast<size_t>(head + _origin);
 }
 
-void Tape::print(size_t idx, int width) const {
-    std::cout << std::left << std::setw(width) << "Index" + std::to_string(idx) << ": ";
-    for (size_t i = 0; i < _tape.size(); i++) {
-        int num = std::abs(_offset + static_cast<int>(i));
-        std::cout << num << ' ';
-    }
-    std::cout << std::endl;
+void Tape::window(size_t &begin, size_t &end) const {
+    begin = _low;
+    while (begin < _head && _cells[begin] == '_')
+        begin++;
 
-    std::cout << std::left << std::setw(width) << "Tape" + std::to_string(idx) << ": ";
-    for (size_t i = 0; i < _tape.size(); i++) {
-        int num = std::abs(_offset + static_cast<int>(i));
-        std::cout << std::left << std::setw(static_cast<int>(std::to_string(num).size()))
-                  << _tape[i] << ' ';
-    }
-    std::cout << std::endl;
+    end = _high + 1;
+    while (end - 1 > _head && _cells[end - 1] == '_')
+        end--;
+}
 
-    std::cout << std::left << std::setw(width) << "Head" + std::to_string(idx) << ": ";
-    for (int i = 0; i <= _head; i++) {
-        int num = std::abs(_offset + i);
-        std::cout << std::left << std::setw(static_cast<int>(std::to_string(num).size()))
-                  << (i == _head ? "^" : " ") << " ";
+std::string Tape::to_string() const {
+    size_t begin = _low;
+    size_t end = _high + 1;
+    while (begin < end && _cells[begin] == '_')
+        begin++;
+    while (end > begin && _cells[end - 1] == '_')
+        end--;
+
+    return std::string(_cells.begin() + static_cast<std::ptrdiff_t>(begin),
+                       _cells.begin() + static_cast<std::ptrdiff_t>(end));
+}
+
+void Tape::print(std::ostream &out, size_t idx, size_t width) const {
+    size_t begin = 0;
+    size_t end = 0;
+    window(begin, end);
+
+    // Every cell takes as many columns as its index
+    std::string index{};
+    std::string cells{};
+    std::string head{};
+    append_padded(index, "Index" + std::to_string(idx), width);
+    append_padded(cells, "Tape" + std::to_string(idx), width);
+    append_padded(head, "Head" + std::to_string(idx), width);
+    index += ": ";
+    cells += ": ";
+    head += ": ";
+    for (size_t i = begin; i < end; i++) {
+        size_t num = static_cast<size_t>(std::abs(position(i)));
+        index += std::to_string(num);
+        index += ' ';
+        cells += _cells[i];
+        cells.append(digits(num), ' ');
+        if (i <= _head) {
+            head += i == _head ? '^' : ' ';
+            head.append(digits(num), ' ');
+        }
     }
-    std::cout << std::endl;
+    out << index << '\n' << cells << '\n' << head << '\n';
 }
 
-void TMSimulator::run(const std::string &input) {
+Result TMSimulator::run(const std::string &input) {
+    reset();
 
     { // check input
-        for (size_t i = 0; i < input.size(); ++i) {
-            std::string tmp = std::string(1, input[i]);
-
-            if (!_input_alphabet.contains(tmp)) {
-                _error = Error::InputError;
-                _error_logs.push_back("Input: " + input);
-                _error_logs.push_back("==================== ERR ====================");
-                _error_logs.push_back("error: '" + tmp +
-                                      "' was not declared in the set of input symbols");
-                _error_logs.push_back("Input: " + input);
-                _error_logs.push_back(std::string(7 + i, ' ') + std::string(1, '^'));
-                error_handler();
-            }
+        size_t i = _machine->input_alphabet.validate(input);
+        if (i != Alphabet::npos) {
+            _error = Error::InputError;
+            _error_logs.push_back("Input: " + input);
+            _error_logs.push_back("==================== ERR ====================");
+            _error_logs.push_back("error: '" + std::string(1, input[i]) +
+                                  "' was not declared in the set of input symbols");
+            _error_logs.push_back("Input: " + input);
+            _error_logs.push_back(std::string(7 + i, ' ') + std::string(1, '^'));
+            error_handler();
         }
     }
 
+    if (_machine->nondeterministic)
+        return run_nondeterministic(input);
+    // Without a trace or cycle detection nothing has to happen between steps. Only the
+    // threaded program and step() know which rule fired.
+    bool plain = !_verbose && !_trace && !_detect_cycles;
+    if (_profile)
+        _stats.fires.assign(_machine->transition_count(), 0);
+    if (plain && !_profile && _tape_backend == TapeBackend::RunLength)
+        return run_run_length(input);
+
     { // init TM
-        _tapes.resize(_tape_number);
+        _tapes.resize(_machine->tape_number);
         _tapes[0].init(input);
-        _current_state = _start_state;
 
         if (_verbose) {
             std::cout << "Input: " + input << std::endl;
             std::cout << "==================== RUN ====================" << std::endl;
         }
+        if (_trace) {
+            _trace->run('T', _machine->states);
+            _trace->size(_tapes.size());
+            _trace->string(input);
+            _trace->size(_current_state);
+        }
     }
 
-    while (true) {
-        if (_verbose)
+    if (plain && !_profile && _macro_block != 0 && _tapes.size() == 1) {
+        run_macro();
+        return finish();
+    }
+    if (plain && !_machine->program.empty()) {
+        run_threaded();
+        return finish();
+    }
+
+    bool ring = _verbose && _filter.ring != 0;
+    if (_verbose)
+        start_filter(_machine->states);
+    if (ring) {
+        _ring_states.assign(_filter.ring, 0);
+        _ring_heads.assign(_filter.ring * _tapes.size(), 0);
+        _ring_symbols.assign(_filter.ring * _tapes.size(), '_');
+    }
+
+    // The threaded program takes the steps up to the next one the trace filter prints, when
+    // nothing else watches them
+    bool skip = _verbose && !_trace && !_detect_cycles && !ring && _filter.states.empty() &&
+                !_machine->program.empty();
+
+    bool dense = !_machine->dense_table.empty() && !_profile;
+    HaltReason limit = HaltReason::Limit;
+    while (!_halted) {
+        if (skip && _counter < _next_print) {
+            run_threaded(_next_print);
+            continue;
+        }
+        if (ring) {
+            size_t slot = _counter % _ring_states.size();
+            _ring_states[slot] = _current_state;
+            for (size_t i = 0; i < _tapes.size(); ++i) {
+                _ring_heads[slot * _tapes.size() + i] = _tapes[i].head();
+                _ring_symbols[slot * _tapes.size() + i] = _tapes[i].read();
+            }
+        } else if (_verbose && selected(_counter, _current_state)) {
             print_state();
+        }
+
+        if (limit_reached(_counter, cells(), limit))
+            halt(limit);
+        else if (_detect_cycles && in_cycle())
+            halt(HaltReason::Loop);
+        else if (!(dense ? step_dense() : step()))
+            halt(HaltReason::NoTransition);
+        else
+            _counter++;
+    }
+    if (_trace)
+        _trace->byte(trace_end);
+    return finish();
+}
+
+void TMSimulator::name_profile() {
+    const CompiledTM &machine = *_machine;
+    _stats.states.clear();
+    for (size_t i = 0; i < machine.states.size(); ++i)
+        _stats.states.push_back(machine.states.name(i));
+    _stats.rules.clear();
+    for (size_t id = 0; id < machine.transition_count(); ++id) {
+        const CompiledTM::Transition transition = machine.transition(id);
+        size_t tapes = machine.tape_number;
+        _stats.rules.push_back(machine.states.name(transition.state) + ' ' +
+                               std::string(transition.old_str, tapes) + ' ' +
+                               std::string(transition.new_str, tapes) + ' ' +
+                               std::string(transition.direction, tapes) + ' ' +
+                               machine.states.name(transition.next_state));
+    }
+}
+
+Result TMSimulator::finish() {
+    for (const Tape &tape : _tapes)
+        _stats.tape_cells.push_back(tape.size());
+
+    if (_profile) { // a step leaves the state of its rule
+        name_profile();
+        _stats.visits.assign(_machine->states.size(), 0);
+        _stats.visits[_current_state]++;
+        for (size_t i = 0; i < _machine->transition_count(); ++i)
+            _stats.visits[_machine->rule_states[i]] += _stats.fires[i];
+    }
+
+    return Result{_machine->accepting[_current_state], _tapes[0].to_string(), _counter,
+                  _halt_reason};
+}
 
-        step();
-        _counter++;
+void TMSimulator::reset() noexcept {
+    Simulator::reset();
+
+    _counter = 0;
+    _tapes.clear();
+    _current_state = _machine ? _machine->start_state : 0;
+    _accept = false;
+    _next_save = 0;
+    _ring_states.clear();
+}
+
+std::unique_ptr<Simulator> TMSimulator::clone() const {
+    auto simulator = std::make_unique<TMSimulator>();
+    simulator->Simulator::operator=(*this); // settings
+    simulator->_machine = _machine;
+    simulator->_search_strategy = _search_strategy;
+    simulator->_macro_block = _macro_block;
+    simulator->_tape_backend = _tape_backend;
+    simulator->reset();
+    return simulator;
+}
+
+size_t TMSimulator::cells() const {
+    size_t cells = 0;
+    for (const Tape &tape : _tapes)
+        cells += tape.size();
+    return cells;
+}
+
+bool TMSimulator::in_cycle() {
+    uint64_t hash = mix(_current_state);
+    for (const Tape &tape : _tapes)
+        hash = mix(hash + tape.hash());
+
+    if (_counter == _next_save) {
+        _next_save = _next_save == 0 ? 1 : _next_save * 2;
+        _saved_state = _current_state;
+        _saved_hash = hash;
+        _saved_tapes = _tapes;
+        return false;
     }
+
+    // The hash rules out almost every configuration, a match is compared in full
+    return hash == _saved_hash && _current_state == _saved_state && _tapes == _saved_tapes;
 }
 
-void TMSimulator::step() {
+bool TMSimulator::step() {
     std::string cur_str(_tapes.size(), '\0');
     std::transform(_tapes.begin(), _tapes.end(), cur_str.begin(),
                    [](const auto &tape) { return tape.read(); });
 
-    Condition current_condition = std::make_tuple(_current_state, SymbolSeq(cur_str));
+    size_t idx = _machine->find_transition(_current_state, SymbolSeq(cur_str));
 
-    auto it = std::find_if(_transitions.begin(), _transitions.end(),
-                           [&current_condition](const auto &transition) {
-                               return transition.first == current_condition;
-                           });
+    if (idx != _machine->transition_count()) {
+        const CompiledTM::Transition transition = _machine->transition(idx);
 
-    if (it != _transitions.end()) {
-        const SymbolSeq &new_str = std::get<0>(it->second);
-        const std::string &direction = std::get<1>(it->second);
-        const State &next_state = std::get<2>(it->second);
+        _current_state = transition.next_state;
+        for (size_t i = 0; i < _tapes.size(); ++i) {
+            _tapes[i].step(transition.new_str[i], transition.direction[i]);
+        }
+        if (_trace)
+            record_step(transition.new_str, transition.direction);
+        if (_profile)
+            _stats.fires[idx]++;
+        return true;
+    }
+
+    return false;
+}
 
-        _current_state = next_state;
-        for (size_t i = 0; i < _tape_number; ++i) {
-            _tapes[i].step(new_str[i], direction[i]);
+bool TMSimulator::step_dense() {
+    const CompiledTM &machine = *_machine;
+
+    size_t entry = _current_state;
+    for (const Tape &tape : _tapes)
+        entry = entry * machine.dense_symbols.size() +
+                machine.dense_ids[static_cast<unsigned char>(tape.read())];
+
+    uint64_t action = machine.dense_table[entry];
+    if (!(action & CompiledTM::dense_valid))
+        return false;
+
+    _current_state = static_cast<size_t>(action & 0xffffffff);
+    char symbols[4];
+    char directions[4];
+    for (size_t i = 0; i < _tapes.size(); ++i) {
+        size_t symbol = static_cast<size_t>(action >> (32 + 4 * i)) & 0xf;
+        size_t move = static_cast<size_t>(action >> (48 + 2 * i)) & 0x3;
+        symbols[i] = machine.dense_symbols[symbol];
+        directions[i] = "*lr"[move];
+        _tapes[i].step(symbols[i], directions[i]);
+    }
+    if (_trace)
+        record_step(symbols, directions);
+    return true;
+}
+
+void TMSimulator::record_step(const char *symbols, const char *directions) {
+    _trace->byte(trace_step);
+    _trace->size(_current_state);
+    for (size_t i = 0; i < _tapes.size(); ++i) {
+        _trace->byte(symbols[i]);
+        _trace->byte(directions[i]);
+    }
+}
+
+namespace {
+
+// Whether a rule reading `read` applies to the `count` symbols under the heads
+bool matches(const char *read, const char *symbols, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (read[i] != symbols[i] && (read[i] != '*' || symbols[i] == '_'))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+void CompiledTM::add_transition(size_t state, const std::string &old_str,
+                                const std::string &new_str, const std::string &direction,
+                                size_t next_state) {
+    rule_states.push_back(static_cast<uint32_t>(state));
+    next_states.push_back(static_cast<uint32_t>(next_state));
+    rule_symbols += old_str;
+    rule_symbols += new_str;
+    rule_symbols += direction;
+}
+
+size_t CompiledTM::find_transition(size_t state, const SymbolSeq &symbols) const {
+    const char *read = symbols.to_string().data();
+    const uint32_t *first = rule_index.data() + transition_offsets[2 * state];
+    const uint32_t *wildcards = rule_index.data() + transition_offsets[2 * state + 1];
+    const uint32_t *last = rule_index.data() + transition_offsets[2 * state + 2];
+
+    // The exact rules are sorted by read string, the first equal one comes first in the file
+    size_t found = transition_count();
+    const uint32_t *exact =
+        std::lower_bound(first, wildcards, read, [this](uint32_t rule, const char *key) {
+            return std::memcmp(transition(rule).old_str, key, tape_number) < 0;
+        });
+    if (exact != wildcards && std::memcmp(transition(*exact).old_str, read, tape_number) == 0)
+        found = *exact;
+
+    // A wildcard rule only wins if it was declared before the exact match
+    for (const uint32_t *it = wildcards; it != last && *it < found; ++it) {
+        if (matches(transition(*it).old_str, read, tape_number))
+            return *it;
+    }
+
+    return found;
+}
+
+void CompiledTM::find_transitions(size_t state, const SymbolSeq &symbols,
+                                  std::vector<size_t> &ids) const {
+    const char *read = symbols.to_string().data();
+    const uint32_t *first = rule_index.data() + transition_offsets[2 * state];
+    const uint32_t *wildcards = rule_index.data() + transition_offsets[2 * state + 1];
+    const uint32_t *last = rule_index.data() + transition_offsets[2 * state + 2];
+
+    ids.clear();
+    const uint32_t *exact =
+        std::lower_bound(first, wildcards, read, [this](uint32_t rule, const char *key) {
+            return std::memcmp(transition(rule).old_str, key, tape_number) < 0;
+        });
+    for (; exact != wildcards && std::memcmp(transition(*exact).old_str, read, tape_number) == 0;
+         ++exact)
+        ids.push_back(*exact);
+
+    size_t exact_count = ids.size();
+    for (const uint32_t *it = wildcards; it != last; ++it) {
+        if (matches(transition(*it).old_str, read, tape_number))
+            ids.push_back(*it);
+    }
+    std::inplace_merge(ids.begin(), ids.begin() + static_cast<std::ptrdiff_t>(exact_count),
+                       ids.end());
+}
+
+void CompiledTM::build_index() {
+    // Counting sort by state, the rules without '*' of a state before the ones with '*'
+    size_t count = transition_count();
+    std::vector<bool> wildcard(count, false);
+    transition_offsets.assign(2 * states.size() + 1, 0);
+    for (size_t i = 0; i < count; ++i) {
+        const Transition transition = this->transition(i);
+        wildcard[i] = std::memchr(transition.old_str, '*', tape_number) != nullptr;
+        transition_offsets[2 * transition.state + (wildcard[i] ? 2 : 1)]++;
+    }
+    for (size_t i = 1; i < transition_offsets.size(); ++i)
+        transition_offsets[i] += transition_offsets[i - 1];
+
+    std::vector<uint32_t> next(transition_offsets.begin(), transition_offsets.end() - 1);
+    rule_index.assign(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t &slot = next[2 * size_t(rule_states[i]) + (wildcard[i] ? 1 : 0)];
+        rule_index[slot++] = static_cast<uint32_t>(i);
+    }
+
+    for (size_t state = 0; state < states.size(); ++state) {
+        std::stable_sort(rule_index.begin() + transition_offsets[2 * state],
+                         rule_index.begin() + transition_offsets[2 * state + 1],
+                         [this](uint32_t lhs, uint32_t rhs) {
+                             return std::memcmp(transition(lhs).old_str,
+                                                transition(rhs).old_str, tape_number) < 0;
+                         });
+    }
+}
+
+std::string CompiledTM::tape_symbols() const {
+    std::string symbols = "_";
+    auto add = [&symbols](char c) {
+        if (c != '*' && symbols.find(c) == std::string::npos)
+            symbols.push_back(c);
+    };
+    for (char c : input_alphabet.symbols())
+        add(c);
+    for (size_t id = 0; id < transition_count(); ++id) {
+        const Transition transition = this->transition(id);
+        for (size_t i = 0; i < tape_number; ++i) {
+            add(transition.old_str[i]);
+            add(transition.new_str[i]);
         }
-        return;
     }
+    return symbols;
+}
+
+void CompiledTM::build_dense_table(size_t limit) {
+    dense_symbols.clear();
+    dense_table.clear();
+    if (nondeterministic || tape_number > 4 || states.size() > 0xffffffff)
+        return;
+
+    std::string symbols = tape_symbols();
+    if (symbols.size() > 16)
+        return;
 
-    halt();
+    size_t rows = 1; // entries per state
+    for (size_t i = 0; i < tape_number; ++i)
+        rows *= symbols.size();
+    if (states.size() > limit / sizeof(uint64_t) / rows)
+        return;
+
+    dense_symbols = symbols;
+    dense_ids.fill(0);
+    for (size_t i = 0; i < symbols.size(); ++i)
+        dense_ids[static_cast<unsigned char>(symbols[i])] = static_cast<uint8_t>(i);
+    dense_table.assign(states.size() * rows, 0);
+
+    // Rules are written in reverse so the first matching one in file order wins, as in
+    // find_transition(). A '*' matches every symbol but the blank and writes back what it read.
+    std::vector<size_t> read(tape_number);
+    for (size_t id = transition_count(); id > 0; --id) {
+        const Transition transition = this->transition(id - 1);
+        auto first = [&](size_t i) -> size_t {
+            return transition.old_str[i] == '*'
+                       ? 1
+                       : dense_ids[static_cast<unsigned char>(transition.old_str[i])];
+        };
+        for (size_t i = 0; i < tape_number; ++i)
+            read[i] = first(i);
+
+        while (true) {
+            size_t entry = transition.state;
+            uint64_t action = dense_valid | transition.next_state;
+            for (size_t i = 0; i < tape_number; ++i) {
+                char symbol = transition.new_str[i];
+                uint64_t write =
+                    symbol == '*' ? read[i] : dense_ids[static_cast<unsigned char>(symbol)];
+                uint64_t move = transition.direction[i] == 'l'   ? 1
+                                : transition.direction[i] == 'r' ? 2
+                                                                 : 0;
+                entry = entry * symbols.size() + read[i];
+                action |= write << (32 + 4 * i) | move << (48 + 2 * i);
+            }
+            dense_table[entry] = action;
+
+            // Next combination of the symbols matched by the wildcards, like an odometer
+            size_t i = tape_number;
+            for (; i > 0; --i) {
+                if (transition.old_str[i - 1] == '*' && read[i - 1] + 1 < symbols.size()) {
+                    read[i - 1]++;
+                    break;
+                }
+                read[i - 1] = first(i - 1);
+            }
+            if (i == 0) // every combination is done
+                break;
+        }
+    }
 }
 
-void TMSimulator::halt() noexcept {
+void TMSimulator::halt(HaltReason reason) noexcept {
+    Simulator::halt(reason);
+
     if (_verbose) {
+        if (!_ring_states.empty())
+            print_ring();
         std::clog << "Halted after " << _counter << " steps." << std::endl;
         std::cout << "Result: " << _tapes[0].to_string() << std::endl;
         std::cout << "==================== END ====================" << std::endl;
-    } else
-        std::cout << _tapes[0].to_string() << std::endl;
-
-    exit(EXIT_SUCCESS);
+    }
 }
 
 void TMSimulator::print_state() {
-    int width = 5 + static_cast<int>(std::to_string(_tape_number).size()) + 1;
-    std::cout << std::left << std::setw(width) << "Step" << ": " << _counter << std::endl;
-    std::cout << std::left << std::setw(width) << "State" << ": " << _current_state.name()
-              << std::endl;
-    for (size_t i = 0; i < _tapes.size(); ++i)
-        _tapes[i].print(i, width);
-    std::cout << "---------------------------------------------" << std::endl;
+    print_step(std::cout, _counter, _machine->states.name(_current_state), _tapes);
+}
+
+void TMSimulator::print_ring() {
+    // Undo the kept steps on a copy of the configuration, from the last one back
+    size_t count = std::min(_ring_states.size(), _counter + 1);
+    size_t state = _current_state;
+    std::vector<Tape> tapes(_tapes);
+    std::vector<std::string> blocks(count);
+    std::vector<size_t> states(count);
+    for (size_t i = count; i-- > 0;) {
+        std::ostringstream block{};
+        print_step(block, _counter - (count - 1 - i), _machine->states.name(state), tapes);
+        blocks[i] = block.str();
+        states[i] = state;
+        if (i == 0)
+            break;
+
+        size_t slot = (_counter - (count - i)) % _ring_states.size();
+        for (size_t j = 0; j < tapes.size(); ++j) {
+            int head = _ring_heads[slot * tapes.size() + j];
+            std::string symbol(1, _ring_symbols[slot * tapes.size() + j]);
+            tapes[j].write_block(head, symbol, head, head, head);
+        }
+        state = _ring_states[slot];
+    }
+
+    start_filter(_machine->states);
+    for (size_t i = 0; i < count; ++i) {
+        if (selected(_counter - (count - 1 - i), states[i]))
+            std::cout << blocks[i];
+    }
+}
+
+void TMSimulator::print_step(std::ostream &out, size_t step, const std::string &state,
+                             const std::vector<Tape> &tapes) {
+    size_t width = 5 + digits(tapes.size()) + 1;
+    std::string lines{};
+    append_padded(lines, "Step", width);
+    lines += ": " + std::to_string(step) + '\n';
+    append_padded(lines, "State", width);
+    lines += ": " + state + '\n';
+    out << lines;
+    for (size_t i = 0; i < tapes.size(); ++i)
+        tapes[i].print(out, i, width);
+    out << "---------------------------------------------\n";
 }
 
 } // namespace fla
@@ -0,0 +1,286 @@
+#include <fla/tm.h>
+
+#include <fstream>
+#include <sstream>
+
+namespace fla {
+
+namespace {
+
+// Everything of the generated simulator that does not depend on the machine
+const char *const codegen_prelude = R"(#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A tape in one flat buffer, reused by every run and only reallocated when a head leaves it
+struct Tape {
+    std::vector<char> cells = std::vector<char>(1024, '_');
+    size_t head = 0;
+    size_t low = 0; // every cell outside [low, high] is blank
+    size_t high = 0;
+
+    void init(const std::string &input) {
+        std::fill(cells.begin() + static_cast<std::ptrdiff_t>(low),
+                  cells.begin() + static_cast<std::ptrdiff_t>(high) + 1, '_');
+        if (cells.size() < 2 * input.size() + 2)
+            cells.resize(2 * input.size() + 2, '_');
+        head = low = (cells.size() - input.size()) / 2;
+        std::copy(input.begin(), input.end(), cells.begin() + static_cast<std::ptrdiff_t>(head));
+        high = input.empty() ? head : head + input.size() - 1;
+    }
+    char read() const { return cells[head]; }
+    void write(char symbol) { cells[head] = symbol; }
+    void left() {
+        if (head == 0)
+            grow();
+        if (--head < low)
+            low = head;
+    }
+    void right() {
+        if (head + 1 == cells.size())
+            grow();
+        if (++head > high)
+            high = head;
+    }
+    void grow() {
+        size_t extra = cells.size() / 2;
+        cells.insert(cells.begin(), extra, '_');
+        cells.resize(cells.size() + extra, '_');
+        head += extra;
+        low += extra;
+        high += extra;
+    }
+    std::string to_string() const {
+        size_t begin = low;
+        size_t end = high + 1;
+        while (begin < end && cells[begin] == '_')
+            begin++;
+        while (end > begin && cells[end - 1] == '_')
+            end--;
+        return std::string(cells.begin() + static_cast<std::ptrdiff_t>(begin),
+                           cells.begin() + static_cast<std::ptrdiff_t>(end));
+    }
+};
+
+)";
+
+const char *const codegen_main = R"(
+// Returns the line fla prints for `input`
+std::string simulate(const std::string &input, size_t max_steps, bool &valid) {
+    valid = input.find_first_not_of(input_symbols) == std::string::npos;
+    if (!valid)
+        return "illegal input";
+
+    tapes[0].init(input);
+    for (size_t i = 1; i < sizeof(tapes) / sizeof(tapes[0]); ++i)
+        tapes[i].init("");
+
+    bool limit = false;
+    run(max_steps == 0 ? std::numeric_limits<size_t>::max() : max_steps, limit);
+    return limit ? "limit" : tapes[0].to_string();
+}
+
+int run_batch(std::istream &in, size_t max_steps) {
+    int status = EXIT_SUCCESS;
+    std::string input;
+    while (std::getline(in, input)) {
+        if (!input.empty() && input.back() == '\r')
+            input.pop_back();
+        bool valid = true;
+        std::string result = simulate(input, max_steps, valid);
+        if (!valid) {
+            std::cerr << "illegal input\n";
+            status = EXIT_FAILURE;
+        }
+        std::cout << result << '\n';
+    }
+    std::cout.flush();
+    return status;
+}
+
+void print_usage(const char *name) {
+    std::cerr << "Usage:\t" << name << " [-h|--help]\n";
+    std::cerr << "      \t" << name << " [--max-steps <n>] <input>\n";
+    std::cerr << "      \t" << name << " [--max-steps <n>] -b|--batch [<inputs>]\n";
+}
+
+} // namespace
+
+int main(int argc, const char *argv[]) {
+    bool batch = false;
+    size_t max_steps = 0;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            print_usage(argv[0]);
+            return EXIT_SUCCESS;
+        } else if (arg == "-b" || arg == "--batch") {
+            batch = true;
+        } else if (arg == "--max-steps") {
+            try {
+                if (i + 1 == argc || argv[i + 1][0] == '-')
+                    throw std::invalid_argument(arg);
+                std::string value = argv[++i];
+                size_t end = 0;
+                max_steps = std::stoul(value, &end);
+                if (end != value.size())
+                    throw std::invalid_argument(value);
+            } catch (const std::logic_error &) {
+                std::cerr << "Invalid value for option: " << arg << std::endl;
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    if (batch ? args.size() > 1 : args.size() != 1) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (batch) {
+        if (args.empty())
+            return run_batch(std::cin, max_steps);
+        std::ifstream fin(args[0]);
+        if (!fin.is_open()) {
+            std::cerr << "Could not open the file: " << args[0] << std::endl;
+            return EXIT_FAILURE;
+        }
+        return run_batch(fin, max_steps);
+    }
+
+    bool valid = true;
+    std::string result = simulate(args[0], max_steps, valid);
+    if (!valid) {
+        std::cerr << result << '\n';
+        return EXIT_FAILURE;
+    }
+    std::cout << result << std::endl;
+    return EXIT_SUCCESS;
+}
+)";
+
+// A C++ character literal for `symbol`
+std::string literal(char symbol) {
+    if (symbol == '\'' || symbol == '\\')
+        return std::string("'\\") + symbol + "'";
+    return std::string("'") + symbol + "'";
+}
+
+} // namespace
+
+void TMSimulator::codegen(const std::string &filepath) {
+    const CompiledTM &machine = *_machine;
+    if (machine.nondeterministic) {
+        _error_logs.push_back("Error: Only deterministic machines can be generated");
+        _error = Error::OtherError;
+        error_handler();
+    }
+
+    std::vector<std::vector<size_t>> rules(machine.states.size());
+    for (size_t i = 0; i < machine.transition_count(); ++i)
+        rules[machine.rule_states[i]].push_back(i);
+
+    // States the start state cannot reach get no code, so every label is used
+    std::vector<bool> reachable(machine.states.size(), false);
+    std::vector<size_t> pending = {machine.start_state};
+    reachable[machine.start_state] = true;
+    while (!pending.empty()) {
+        size_t state = pending.back();
+        pending.pop_back();
+        for (size_t rule : rules[state]) {
+            size_t next = machine.next_states[rule];
+            if (!reachable[next]) {
+                reachable[next] = true;
+                pending.push_back(next);
+            }
+        }
+    }
+
+    std::ostringstream out;
+    out << "// Simulator of one Turing machine, generated by `fla codegen`. It prints the same\n"
+           "// results as `fla <tm> <input>`. Build it with any C++14 compiler, e.g.\n"
+           "//     c++ -std=c++14 -O2 -o simulator <this file>\n\n";
+    out << codegen_prelude;
+
+    std::string symbols = machine.input_alphabet.symbols();
+    out << "const char input_symbols[] = {";
+    for (char symbol : symbols)
+        out << literal(symbol) << ", ";
+    out << "'\\0'};\n";
+    out << "Tape tapes[" << machine.tape_number << "];\n\n";
+
+    // One block per state, the rules are tried in file order as in find_transition()
+    out << "void run(size_t max_steps, bool &limit) {\n";
+    out << "    size_t steps = 0;\n";
+    out << "    goto state_" << machine.start_state << ";\n";
+    for (size_t state = 0; state < machine.states.size(); ++state) {
+        if (!reachable[state])
+            continue;
+
+        out << "\nstate_" << state << ": { // " << machine.states.name(state) << "\n";
+        out << "    if (steps == max_steps) {\n"
+               "        limit = true;\n"
+               "        return;\n"
+               "    }\n";
+        if (!rules[state].empty()) {
+            for (size_t i = 0; i < machine.tape_number; ++i)
+                out << "    const char c" << i << " = tapes[" << i << "].read();\n";
+        }
+
+        for (size_t rule : rules[state]) {
+            const CompiledTM::Transition transition = machine.transition(rule);
+            out << "    if (";
+            for (size_t i = 0; i < machine.tape_number; ++i) {
+                if (i != 0)
+                    out << " && ";
+                if (transition.old_str[i] == '*')
+                    out << "c" << i << " != '_'";
+                else
+                    out << "c" << i << " == " << literal(transition.old_str[i]);
+            }
+            out << ") {\n";
+
+            for (size_t i = 0; i < machine.tape_number; ++i) {
+                if (transition.new_str[i] != '*' && transition.new_str[i] != transition.old_str[i])
+                    out << "        tapes[" << i << "].write(" << literal(transition.new_str[i])
+                        << ");\n";
+                if (transition.direction[i] == 'l')
+                    out << "        tapes[" << i << "].left();\n";
+                else if (transition.direction[i] == 'r')
+                    out << "        tapes[" << i << "].right();\n";
+            }
+            out << "        ++steps;\n";
+            out << "        goto state_" << transition.next_state << ";\n";
+            out << "    }\n";
+        }
+        out << "    return;\n";
+        out << "}\n";
+    }
+    out << "}\n";
+    out << codegen_main;
+
+    std::ofstream fout(filepath);
+    fout << out.str();
+    if (!fout) {
+        _error_logs.push_back("Error: Could not write the file: " + filepath);
+        _error = Error::OtherError;
+        error_handler();
+    }
+}
+
+} // namespace fla
@@ -0,0 +1,92 @@
+#include <fla/image.h>
+#include <fla/tm.h>
+
+namespace fla {
+
+void TMSimulator::save(const std::string &filepath) {
+    const CompiledTM &machine = *_machine;
+    ImageWriter image('T');
+
+    image.byte(machine.nondeterministic);
+    image.u64(machine.states.size());
+    for (size_t i = 0; i < machine.states.size(); ++i)
+        image.string(machine.states.name(i));
+    image.string(machine.input_alphabet.symbols());
+    image.u64(machine.tape_number);
+    image.u64(machine.start_state);
+    for (bool accepting : machine.accepting)
+        image.byte(accepting);
+
+    // The records and the index are stored as they are laid out in memory
+    image.array(machine.rule_states);
+    image.array(machine.next_states);
+    image.string(machine.rule_symbols);
+    image.array(machine.transition_offsets);
+    image.array(machine.rule_index);
+
+    write_image(filepath, image);
+}
+
+void TMSimulator::load(const std::string &filepath) {
+    auto machine = std::make_shared<CompiledTM>();
+
+    read_image(filepath, 'T', [&machine](ImageReader &image) {
+        machine->nondeterministic = image.byte() != 0;
+        size_t states = image.size();
+        for (size_t i = 0; i < states; ++i) {
+            if (machine->states.intern(image.string()) != i)
+                return false;
+        }
+        for (char c : image.string())
+            machine->input_alphabet.add(std::string(1, c));
+        machine->tape_number = image.size();
+        machine->start_state = image.size();
+        for (size_t i = 0; i < states; ++i)
+            machine->accepting.push_back(image.byte() != 0);
+
+        // Only the structure is checked, the machine was validated when it was compiled
+        image.array(machine->rule_states);
+        image.array(machine->next_states);
+        machine->rule_symbols = image.string();
+        image.array(machine->transition_offsets);
+        image.array(machine->rule_index);
+
+        size_t rules = machine->rule_states.size();
+        const std::vector<uint32_t> &offsets = machine->transition_offsets;
+        if (machine->tape_number == 0 || machine->start_state >= states ||
+            machine->next_states.size() != rules || machine->rule_index.size() != rules ||
+            offsets.size() != 2 * states + 1 || offsets.front() != 0 || offsets.back() != rules)
+            return false;
+        size_t symbols = machine->rule_symbols.size(); // 3 * tape_number per rule
+        if (rules == 0 ? symbols != 0
+                       : symbols % (3 * rules) != 0 ||
+                             symbols / (3 * rules) != machine->tape_number)
+            return false;
+        for (size_t i = 0; i < rules; ++i) {
+            if (machine->next_states[i] >= states)
+                return false;
+        }
+
+        // Every rule is in the slice of its state
+        for (size_t i = 1; i < offsets.size(); ++i) {
+            if (offsets[i] < offsets[i - 1])
+                return false;
+        }
+        for (size_t state = 0; state < states; ++state) {
+            for (size_t i = offsets[2 * state]; i < offsets[2 * state + 2]; ++i) {
+                uint32_t rule = machine->rule_index[i];
+                if (rule >= rules || machine->rule_states[rule] != state)
+                    return false;
+            }
+        }
+        return true;
+    });
+    machine->build_dense_table(_table_limit);
+    machine->build_program(_table_limit);
+
+    _nondeterministic = machine->nondeterministic;
+    _machine = machine;
+    _macro_steps.clear();
+}
+
+} // namespace fla
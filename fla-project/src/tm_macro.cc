@@ -0,0 +1,115 @@
+#include <fla/tm.h>
+
+#include <algorithm>
+
+namespace fla {
+
+namespace {
+
+// Steps a block is simulated for before the run inside it is taken as endless
+const size_t block_step_limit = 1 << 16;
+// Macro steps kept before the cache is dropped, and the bytes they may take at most: each
+// holds a key and a result block as wide as the block
+const size_t macro_cache_limit = 1 << 20;
+const size_t macro_cache_bytes = size_t(1) << 28;
+
+} // namespace
+
+void TMSimulator::run_macro() {
+    HaltReason limit = HaltReason::Limit;
+    size_t clock = 0; // _counter / 1024 when the clock was last read
+    while (!_halted) {
+        if (limit_reached(_counter, cells(), limit)) {
+            halt(limit);
+            continue;
+        }
+
+        // A macro step may pass the multiple of 1024 steps at which limit_reached() reads the
+        // clock
+        if (_counter / 1024 != clock) {
+            clock = _counter / 1024;
+            if (timed_out()) {
+                halt(HaltReason::Timeout);
+                continue;
+            }
+        }
+
+        if (macro_step())
+            continue;
+        if (!step())
+            halt(HaltReason::NoTransition);
+        else
+            _counter++;
+    }
+}
+
+bool TMSimulator::macro_step() {
+    Tape &tape = _tapes[0];
+    int width = static_cast<int>(_macro_block);
+    int head = tape.head();
+    int first = (head >= 0 ? head / width : -((width - 1 - head) / width)) * width;
+    int offset = head - first;
+    if (offset != 0 && offset != width - 1)
+        return false;
+
+    _macro_key.assign(reinterpret_cast<const char *>(&_current_state), sizeof(_current_state));
+    _macro_key.push_back(offset == 0 ? 'l' : 'r');
+    tape.read_block(first, _macro_block, _macro_key);
+
+    auto it = _macro_steps.find(_macro_key);
+    if (it == _macro_steps.end()) {
+        size_t entry = _macro_key.size() + _macro_block + sizeof(std::string) + sizeof(MacroStep);
+        if (_macro_steps.size() >= std::min(macro_cache_limit, macro_cache_bytes / entry))
+            _macro_steps.clear();
+        std::string block = _macro_key.substr(_macro_key.size() - _macro_block);
+        it = _macro_steps.emplace(_macro_key, simulate_block(_current_state, block, offset)).first;
+    }
+
+    // Fall back to single steps where a limit could be reached inside the block, so runs stop
+    // at the same step as without macro steps
+    const MacroStep &macro = it->second;
+    if (macro.steps == 0 || (_max_steps != 0 && _counter + macro.steps > _max_steps) ||
+        (_max_cells != 0 && cells() + _macro_block + 1 > _max_cells))
+        return false;
+
+    tape.write_block(first, macro.block, first + macro.low, first + macro.high,
+                     first + macro.exit);
+    _current_state = macro.state;
+    _counter += macro.steps;
+    return true;
+}
+
+TMSimulator::MacroStep TMSimulator::simulate_block(size_t state, std::string block,
+                                                   int offset) const {
+    int width = static_cast<int>(block.size());
+    MacroStep macro{std::string(), 0, 0, 0, offset, offset};
+    std::string symbol(1, '_');
+    while (offset >= 0 && offset < width) {
+        if (macro.steps == block_step_limit)
+            return MacroStep{std::string(), 0, 0, 0, 0, 0};
+
+        symbol[0] = block[static_cast<size_t>(offset)];
+        size_t id = _machine->find_transition(state, SymbolSeq(symbol));
+        if (id == _machine->transition_count())
+            return MacroStep{std::string(), 0, 0, 0, 0, 0};
+
+        const CompiledTM::Transition transition = _machine->transition(id);
+        if (transition.new_str[0] != '*')
+            block[static_cast<size_t>(offset)] = transition.new_str[0];
+        if (transition.direction[0] == 'l')
+            offset--;
+        else if (transition.direction[0] == 'r')
+            offset++;
+        macro.low = std::min(macro.low, offset);
+        macro.high = std::max(macro.high, offset);
+        state = transition.next_state;
+        macro.steps++;
+    }
+
+    macro.block = std::move(block);
+    macro.state = state;
+    macro.exit = offset;
+    return macro;
+}
+
+} // namespace fla
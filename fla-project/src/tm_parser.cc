@@ -1,57 +1,91 @@
+#include <fla/source.h>
 #include <fla/tm.h>
 
-#include <fstream>
+#include <algorithm>
 #include <iostream>
-#include <regex>
+#include <sstream>
+#include <tuple>
 
 namespace fla {
 
+namespace {
+
+// Number of read strings without '*' that `read` matches, at most `limit` + 1
+size_t count_matches(const std::string &read, size_t symbols, size_t limit) {
+    size_t count = 1;
+    for (char c : read) {
+        if (c == '*')
+            count = symbols == 0 ? 0 : std::min(count * symbols, limit + 1);
+    }
+    return count;
+}
+
+// Calls `visit` with each read string without '*' that `read` matches, in order, until it
+// returns false. `symbols` are the symbols a '*' matches. Returns whether it never did.
+template <typename Visit>
+bool for_each_match(const std::string &read, const std::string &symbols, Visit visit) {
+    std::vector<size_t> wildcards{};
+    for (size_t i = 0; i < read.size(); ++i) {
+        if (read[i] == '*')
+            wildcards.push_back(i);
+    }
+    if (!wildcards.empty() && symbols.empty())
+        return true;
+
+    std::string match = read;
+    std::vector<size_t> digits(wildcards.size(), 0);
+    while (true) {
+        for (size_t i = 0; i < wildcards.size(); ++i)
+            match[wildcards[i]] = symbols[digits[i]];
+        if (!visit(match))
+            return false;
+
+        size_t i = 0;
+        for (; i < digits.size() && ++digits[i] == symbols.size(); ++i)
+            digits[i] = 0;
+        if (i == digits.size())
+            return true;
+    }
+}
+
+// Whether a rule reading `rule` applies wherever a rule reading `read` does
+bool covers(const std::string &rule, const std::string &read) {
+    for (size_t i = 0; i < read.size(); ++i) {
+        if (rule[i] != read[i] && (rule[i] != '*' || read[i] == '_'))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
 void TMSimulator::parse(const std::string &filepath) {
     std::clog << "Parsing TM from file: " << filepath << std::endl;
-    std::ifstream fin(filepath);
+    SourceFile source(filepath);
 
-    if (!fin.is_open()) {
+    if (!source.is_open()) {
         _error_logs.push_back("Error: Could not open the file: " + filepath);
         _error = Error::OtherError;
         error_handler();
     }
 
-    // Init the parse_handlers
-    std::vector<std::pair<std::regex, std::function<void(const std::string &)>>> parse_handlers = {
-        {
-            std::regex(R"(#Q = \{([^}]+)\})"),
-            [this](const std::string &line) -> void { this->parse_states(line); },
-        },
-        {
-            std::regex(R"(#S = \{([^}]+)\})"),
-            [this](const std::string &line) -> void { this->parse_input_alphabet(line); },
-        },
-        {
-            std::regex(R"(#G = \{([^}]+)\})"),
-            [this](const std::string &line) -> void { this->parse_stack_alphabet(line); },
-        },
-        {
-            std::regex(R"(#q0 = ([^ ]+))"),
-            [this](const std::string &line) -> void { this->parse_start_state(line); },
-        },
-        {
-            std::regex(R"(#B = ([^ ]+))"),
-            [this](const std::string &line) -> void { this->parse_empty_symbol(line); },
-        },
-        {
-            std::regex(R"(#F = \{([^}]+)\})"),
-            [this](const std::string &line) -> void { this->parse_accept_states(line); },
-        },
-        {
-            std::regex(R"(#N = ([^ ]+))"),
-            [this](const std::string &line) -> void { this->parse_tape_number(line); },
-        },
+    // Lines that are not directives are transitions
+    using Handler = void (TMSimulator::*)(const std::string &);
+    const std::vector<std::tuple<std::string, bool, Handler>> directives = {
+        std::make_tuple("#Q", true, &TMSimulator::parse_states),
+        std::make_tuple("#S", true, &TMSimulator::parse_input_alphabet),
+        std::make_tuple("#G", true, &TMSimulator::parse_stack_alphabet),
+        std::make_tuple("#q0", false, &TMSimulator::parse_start_state),
+        std::make_tuple("#B", false, &TMSimulator::parse_empty_symbol),
+        std::make_tuple("#F", true, &TMSimulator::parse_accept_states),
+        std::make_tuple("#N", false, &TMSimulator::parse_tape_number),
     };
 
     std::string line;
+    std::string value;
     size_t line_number = 0;
 
-    while (std::getline(fin, line)) {
+    while (source.next_line(line)) {
         line_number++;
 
         ignore_after(line, ';');
@@ -61,10 +95,9 @@ void TMSimulator::parse(const std::string &filepath) {
             continue;
 
         bool matched = false;
-        for (const auto &handler : parse_handlers) {
-            std::smatch match;
-            if (std::regex_match(line, match, handler.first)) {
-                handler.second(match[1]);
+        for (const auto &directive : directives) {
+            if (match_directive(line, std::get<0>(directive), std::get<1>(directive), value)) {
+                (this->*std::get<2>(directive))(value);
                 matched = true;
                 break;
             }
@@ -80,6 +113,10 @@ void TMSimulator::parse(const std::string &filepath) {
     }
 
     { // check the configuration of TM
+        if (_overlaps != 0 && !_nondeterministic)
+            _error_logs.push_back("Overlapping transition conditions: " +
+                                  std::to_string(_overlaps));
+
         if (_states.empty())
             _error_logs.push_back("No states defined");
 
@@ -106,6 +143,8 @@ void TMSimulator::parse(const std::string &filepath) {
             error_handler();
         }
     }
+
+    compile();
 }
 
 void TMSimulator::parse_states(const std::string &line) {
@@ -118,7 +157,7 @@ void TMSimulator::parse_states(const std::string &line) {
             _error_logs.push_back("Invalid state name: " + tmp);
             return;
         }
-        _states.insert(State(tmp));
+        _states.intern(tmp);
     }
 }
 
@@ -201,12 +240,8 @@ void TMSimulator::parse_tape_number(const std::string &line) {
 }
 
 void TMSimulator::parse_transitions(const std::string &line) {
-    std::stringstream ss(line);
-    std::string item;
     std::vector<std::string> elements;
-
-    while (ss >> item)
-        elements.push_back(item);
+    split_whitespace(line, elements);
 
     if (elements.size() != 5) {
         _error_logs.push_back("Incorrect transition format");
@@ -222,19 +257,19 @@ void TMSimulator::parse_transitions(const std::string &line) {
 
     { // check the grammar of transition
 
-        if (_states.find(State(from_state)) == _states.end())
+        if (_states.find(from_state) == SymbolTable::npos)
             _error_logs.push_back("Invalid from state name: " + from_state);
 
         if (old_str.size() != _tape_number)
             _error_logs.push_back("Invalid old string: " + old_str);
         for (char c : old_str)
-            if (c != '*' && !_tape_alphabet.contains(std::string(1, c)))
+            if (c != '*' && !_tape_alphabet.contains(c))
                 _error_logs.push_back("Invalid old string: " + old_str);
 
         if (new_str.size() != _tape_number)
             _error_logs.push_back("Invalid new string: " + new_str);
         for (char c : new_str)
-            if (c != '*' && !_tape_alphabet.contains(std::string(1, c)))
+            if (c != '*' && !_tape_alphabet.contains(c))
                 _error_logs.push_back("Invalid new string: " + new_str);
 
         if (direction_str.size() != _tape_number)
@@ -243,7 +278,7 @@ void TMSimulator::parse_transitions(const std::string &line) {
             if (c != 'l' && c != 'r' && c != '*')
                 _error_logs.push_back("Invalid direction string: " + direction_str);
 
-        if (_states.find(State(to_state)) == _states.end())
+        if (_states.find(to_state) == SymbolTable::npos)
             _error_logs.push_back("Invalid to state name: " + to_state);
 
         for (size_t i = 0; i < new_str.size(); ++i)
@@ -259,16 +294,143 @@ void TMSimulator::parse_transitions(const std::string &line) {
     Condition condition = std::make_tuple(State(from_state), SymbolSeq(old_str));
     Action action = std::make_tuple(SymbolSeq(new_str), direction_str, State(to_state));
 
-    auto duplicate =
-        std::any_of(_transitions.begin(), _transitions.end(),
-                    [&condition](const auto &transition) { return transition.first == condition; });
-    if (duplicate) {
-        _error_logs.push_back("Duplicate transition condition");
-        _error = Error::SyntaxError;
-        return;
+    // A NTM may have any number of transitions for one condition
+    if (!_nondeterministic || _check_overlaps) {
+        std::vector<size_t> overlaps{};
+        find_overlaps(from_state, old_str, _check_overlaps, overlaps);
+
+        if (!overlaps.empty() && !_check_overlaps) {
+            const std::string &read = std::get<1>(_transitions[overlaps[0]].first).to_string();
+            if (read == old_str)
+                _error_logs.push_back("Duplicate transition condition");
+            else
+                _error_logs.push_back("Overlapping transition condition: " + from_state + " " +
+                                      read);
+            _error = Error::SyntaxError;
+            return;
+        }
+
+        if (!overlaps.empty()) {
+            auto rule = [this](size_t id) {
+                const Condition &rule_condition = _transitions[id].first;
+                const Action &rule_action = _transitions[id].second;
+                return "'" + std::get<0>(rule_condition).name() + " " +
+                       std::get<1>(rule_condition).to_string() + " " +
+                       std::get<0>(rule_action).to_string() + " " + std::get<1>(rule_action) +
+                       " " + std::get<2>(rule_action).name() + "'";
+            };
+            // Every matching rule fires in a NTM, so none is ever left out by the ones before it
+            bool all_covered = !_nondeterministic && covered(old_str, overlaps);
+            std::string report =
+                "overlap: '" + line + "'" + (all_covered ? " is covered by " : " overlaps ");
+            for (size_t i = 0; i < overlaps.size(); ++i)
+                report += (i == 0 ? "" : ", ") + rule(overlaps[i]);
+            std::cerr << report + "\n";
+            _overlaps++;
+        }
+
+        ConditionIndex &index = _conditions[from_state];
+        size_t id = _transitions.size();
+        if (old_str.find('*') == std::string::npos) {
+            index.exact[old_str].push_back(id);
+            index.exact_rules.push_back(id);
+        } else {
+            index.wildcard_rules.push_back(id);
+        }
     }
 
     _transitions.push_back(std::make_pair(condition, action));
 }
 
+void TMSimulator::find_overlaps(const std::string &state, const std::string &read, bool all,
+                                std::vector<size_t> &rules) const {
+    auto it = _conditions.find(state);
+    if (it == _conditions.end())
+        return;
+    const ConditionIndex &index = it->second;
+
+    // Exact rules are looked up, a '*' in `read` is expanded unless a scan is cheaper
+    std::string symbols = _tape_alphabet.symbols();
+    symbols.erase(std::remove(symbols.begin(), symbols.end(), '_'), symbols.end());
+    if (count_matches(read, symbols.size(), index.exact_rules.size()) <=
+        index.exact_rules.size()) {
+        for_each_match(read, symbols, [&index, &rules, all](const std::string &match) {
+            auto exact = index.exact.find(match);
+            if (exact != index.exact.end())
+                rules.insert(rules.end(), exact->second.begin(), exact->second.end());
+            return all || rules.empty();
+        });
+    } else {
+        for (size_t rule : index.exact_rules) {
+            if (!all && !rules.empty())
+                break;
+            if (std::get<1>(_transitions[rule].first) == SymbolSeq(read))
+                rules.push_back(rule);
+        }
+    }
+
+    for (size_t rule : index.wildcard_rules) {
+        if (!all && !rules.empty())
+            break;
+        if (std::get<1>(_transitions[rule].first) == SymbolSeq(read))
+            rules.push_back(rule);
+    }
+    std::sort(rules.begin(), rules.end());
+}
+
+bool TMSimulator::covered(const std::string &read, const std::vector<size_t> &rules) const {
+    auto read_of = [this](size_t rule) -> const std::string & {
+        return std::get<1>(_transitions[rule].first).to_string();
+    };
+    for (size_t rule : rules) {
+        if (covers(read_of(rule), read))
+            return true;
+    }
+
+    // Otherwise every match of `read` needs an earlier rule, if there are few enough to try
+    const size_t limit = 1 << 16;
+    std::string symbols = _tape_alphabet.symbols();
+    symbols.erase(std::remove(symbols.begin(), symbols.end(), '_'), symbols.end());
+    if (count_matches(read, symbols.size(), limit) > limit)
+        return false;
+    return for_each_match(read, symbols, [&rules, &read_of](const std::string &match) {
+        auto matches = [&read_of, &match](size_t rule) { return covers(read_of(rule), match); };
+        return std::any_of(rules.begin(), rules.end(), matches);
+    });
+}
+
+void TMSimulator::compile() {
+    auto machine = std::make_shared<CompiledTM>();
+    machine->states = _states;
+    machine->input_alphabet = _input_alphabet;
+    machine->tape_number = _tape_number;
+    machine->nondeterministic = _nondeterministic;
+
+    // The start and accept states are not required to be in #Q
+    SymbolTable &states = machine->states;
+    machine->start_state = states.intern(_start_state.name());
+    std::vector<size_t> accept_ids{};
+    for (const State &state : _accept_states)
+        accept_ids.push_back(states.intern(state.name()));
+
+    machine->accepting.assign(states.size(), false);
+    for (size_t id : accept_ids)
+        machine->accepting[id] = true;
+
+    for (const auto &transition : _transitions) {
+        const Condition &condition = transition.first;
+        const Action &action = transition.second;
+        machine->add_transition(states.find(std::get<0>(condition).name()),
+                                std::get<1>(condition).to_string(),
+                                std::get<0>(action).to_string(), std::get<1>(action),
+                                states.find(std::get<2>(action).name()));
+    }
+    machine->build_index();
+    machine->build_dense_table(_table_limit);
+    machine->build_program(_table_limit);
+
+    _machine = machine;
+    _macro_steps.clear();
+}
+
 } // namespace fla
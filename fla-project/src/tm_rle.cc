@@ -0,0 +1,166 @@
+#include <fla/tm.h>
+
+namespace fla {
+
+void RunLengthTape::init(const std::string &input) {
+    _left.clear();
+    _right.clear();
+    _current = Run{'_', 1};
+    _offset = 0;
+    _position = 0;
+    _low = 0;
+    _high = input.empty() ? 0 : static_cast<int>(input.size()) - 1;
+
+    // Collect the runs from the right end so the first one ends up under the head
+    for (auto it = input.rbegin(); it != input.rend(); ++it) {
+        if (!_right.empty() && _right.back().symbol == *it)
+            _right.back().length++;
+        else
+            _right.push_back(Run{*it, 1});
+    }
+    if (!_right.empty()) {
+        _current = _right.back();
+        _right.pop_back();
+    }
+}
+
+void RunLengthTape::write(char symbol) {
+    Run before{_current.symbol, _offset};
+    Run after{_current.symbol, _current.length - _offset - 1};
+    _current = Run{symbol, 1};
+    _offset = 0;
+
+    if (before.length != 0) {
+        _left.push_back(before);
+    } else if (!_left.empty() && _left.back().symbol == symbol) {
+        _current.length += _left.back().length;
+        _offset = _left.back().length;
+        _left.pop_back();
+    }
+
+    if (after.length != 0) {
+        _right.push_back(after);
+    } else if (!_right.empty() && _right.back().symbol == symbol) {
+        _current.length += _right.back().length;
+        _right.pop_back();
+    }
+}
+
+void RunLengthTape::move_left() {
+    if (_left.empty()) { // the blanks left of the tape join a blank run or start a new one
+        if (_current.symbol == '_') {
+            _current.length++;
+            return;
+        }
+        _right.push_back(_current);
+        _current = Run{'_', 1};
+        return;
+    }
+
+    _right.push_back(_current);
+    _current = _left.back();
+    _left.pop_back();
+    _offset = _current.length - 1;
+}
+
+void RunLengthTape::move_right() {
+    if (_right.empty()) {
+        if (_current.symbol == '_') {
+            _current.length++;
+            _offset++;
+            return;
+        }
+        _left.push_back(_current);
+        _current = Run{'_', 1};
+        _offset = 0;
+        return;
+    }
+
+    _left.push_back(_current);
+    _current = _right.back();
+    _right.pop_back();
+    _offset = 0;
+}
+
+std::string RunLengthTape::to_string() const {
+    std::vector<Run> runs(_left);
+    runs.push_back(_current);
+    runs.insert(runs.end(), _right.rbegin(), _right.rend());
+
+    size_t begin = 0;
+    size_t end = runs.size();
+    while (begin < end && runs[begin].symbol == '_')
+        begin++;
+    while (end > begin && runs[end - 1].symbol == '_')
+        end--;
+
+    size_t length = 0;
+    for (size_t i = begin; i < end; ++i)
+        length += runs[i].length;
+    std::string cells{};
+    cells.reserve(length);
+    for (size_t i = begin; i < end; ++i)
+        cells.append(runs[i].length, runs[i].symbol);
+    return cells;
+}
+
+Result TMSimulator::run_run_length(const std::string &input) {
+    const CompiledTM &machine = *_machine;
+    std::vector<RunLengthTape> tapes(machine.tape_number);
+    tapes[0].init(input);
+
+    bool dense = !machine.dense_table.empty();
+    std::string symbols(machine.tape_number, '_');
+    HaltReason limit = HaltReason::Limit;
+    while (!_halted) {
+        size_t cells = 0;
+        for (const RunLengthTape &tape : tapes)
+            cells += tape.size();
+        if (limit_reached(_counter, cells, limit)) {
+            halt(limit);
+            break;
+        }
+
+        // The same lookups as step() and step_dense()
+        bool moved = false;
+        if (dense) {
+            size_t entry = _current_state;
+            for (const RunLengthTape &tape : tapes)
+                entry = entry * machine.dense_symbols.size() +
+                        machine.dense_ids[static_cast<unsigned char>(tape.read())];
+            uint64_t action = machine.dense_table[entry];
+            if (action & CompiledTM::dense_valid) {
+                _current_state = static_cast<size_t>(action & 0xffffffff);
+                for (size_t i = 0; i < tapes.size(); ++i) {
+                    size_t symbol = static_cast<size_t>(action >> (32 + 4 * i)) & 0xf;
+                    size_t move = static_cast<size_t>(action >> (48 + 2 * i)) & 0x3;
+                    tapes[i].step(machine.dense_symbols[symbol], "*lr"[move]);
+                }
+                moved = true;
+            }
+        } else {
+            for (size_t i = 0; i < tapes.size(); ++i)
+                symbols[i] = tapes[i].read();
+            size_t id = machine.find_transition(_current_state, SymbolSeq(symbols));
+            if (id != machine.transition_count()) {
+                const CompiledTM::Transition transition = machine.transition(id);
+                _current_state = transition.next_state;
+                for (size_t i = 0; i < tapes.size(); ++i)
+                    tapes[i].step(transition.new_str[i], transition.direction[i]);
+                moved = true;
+            }
+        }
+
+        if (!moved)
+            halt(HaltReason::NoTransition);
+        else
+            _counter++;
+    }
+
+    for (const RunLengthTape &tape : tapes)
+        _stats.tape_cells.push_back(tape.size());
+    return Result{machine.accepting[_current_state], tapes[0].to_string(), _counter,
+                  _halt_reason};
+}
+
+} // namespace fla
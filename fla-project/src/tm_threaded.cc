@@ -0,0 +1,224 @@
+#include <fla/tm.h>
+
+#include <algorithm>
+#include <limits>
+
+// GCC and Clang can jump to the address of a label, so each handler ends in its own indirect
+// jump to the next one. Other compilers dispatch through a switch.
+#if defined(__GNUC__)
+#define FLA_THREADED_DISPATCH 1
+#endif
+
+namespace fla {
+
+namespace {
+
+using Opcode = ThreadedProgram::Opcode;
+using Instruction = ThreadedProgram::Instruction;
+
+// Runs the program from `state` for at most `steps` steps and sets `steps` to the number taken.
+// Returns false if the machine halted. Given `fires`, it counts the steps taken by each rule
+// there. Given `link`, it only stores the address of each handler in the instructions of
+// `link`, which must be done once before running it.
+bool execute(const ThreadedProgram &program, Tape *tapes, size_t &state, size_t &steps,
+             uint64_t *fires, ThreadedProgram *link) {
+#ifdef FLA_THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+    static const void *const handlers[] = {&&op_halt, &&op_branch, &&op_apply};
+    if (link) {
+        for (Instruction &instruction : link->code)
+            instruction.handler = handlers[static_cast<size_t>(instruction.opcode)];
+        return false;
+    }
+#define FLA_CASE(label, opcode) label:
+#define FLA_DISPATCH() goto *ip->handler
+#else
+    if (link)
+        return false;
+#define FLA_CASE(label, opcode) case opcode:
+#define FLA_DISPATCH() continue
+#endif
+
+    const Instruction *code = program.code.data();
+    const uint32_t *targets = program.targets.data();
+    const char *actions = program.actions.data();
+    const size_t tape_number = program.tape_number;
+
+    const Instruction *ip = code + program.blocks[state];
+    size_t left = steps;
+
+#ifdef FLA_THREADED_DISPATCH
+    FLA_DISPATCH();
+#else
+    while (true) {
+        switch (ip->opcode) {
+#endif
+
+    FLA_CASE(op_branch, Opcode::Branch) {
+        unsigned char symbol = static_cast<unsigned char>(tapes[ip->tape].read());
+        ip = code + targets[ip->operand + program.ids[symbol]];
+        FLA_DISPATCH();
+    }
+
+    FLA_CASE(op_apply, Opcode::Apply) {
+        const char *action = actions + ip->operand;
+        for (size_t i = 0; i < tape_number; ++i)
+            tapes[i].step(action[i], action[tape_number + i]);
+        state = ip->state;
+        if (fires)
+            fires[ip - code - 1]++;
+        if (--left == 0) {
+            steps -= left;
+            return true;
+        }
+        ip = code + ip->next;
+        FLA_DISPATCH();
+    }
+
+    FLA_CASE(op_halt, Opcode::Halt) {
+        steps -= left;
+        return false;
+    }
+
+#ifdef FLA_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#else
+        }
+    }
+#endif
+#undef FLA_CASE
+#undef FLA_DISPATCH
+}
+
+} // namespace
+
+void TMSimulator::run_threaded(size_t until) {
+    HaltReason limit = HaltReason::Limit;
+    while (!_halted && _counter < until) {
+        if (limit_reached(_counter, cells(), limit)) {
+            halt(limit);
+            break;
+        }
+
+        // Run as many steps as possible without skipping a limit check that could fail. The
+        // clock is only read every 1024 steps and a step grows each tape by at most one cell.
+        size_t steps = std::numeric_limits<size_t>::max();
+        if (_timeout.count() != 0)
+            steps = 1024 - _counter % 1024;
+        if (_max_steps != 0)
+            steps = std::min(steps, _max_steps - _counter);
+        if (_max_cells != 0)
+            steps = std::min(steps, (_max_cells - cells()) / _tapes.size() + 1);
+        steps = std::min(steps, until - _counter);
+
+        uint64_t *fires = _profile ? _stats.fires.data() : nullptr;
+        bool moved = execute(_machine->program, _tapes.data(), _current_state, steps, fires,
+                             nullptr);
+        _counter += steps;
+        if (!moved)
+            halt(HaltReason::NoTransition);
+    }
+}
+
+void CompiledTM::build_program(size_t limit) {
+    program = ThreadedProgram{};
+    if (nondeterministic || tape_number == 0)
+        return;
+
+    ThreadedProgram built{};
+    built.tape_number = tape_number;
+    std::string symbols = tape_symbols();
+    for (size_t i = 0; i < symbols.size(); ++i)
+        built.ids[static_cast<unsigned char>(symbols[i])] = static_cast<uint8_t>(i);
+
+    auto size = [&built]() {
+        return built.code.size() * sizeof(Instruction) +
+               (built.blocks.size() + built.targets.size()) * sizeof(uint32_t) +
+               built.actions.size();
+    };
+
+    built.code.push_back(Instruction{nullptr, Opcode::Halt, 0, 0, 0, 0});
+
+    // One Apply per rule, the blocks of the next states are filled in at the end
+    std::vector<std::vector<size_t>> rules(states.size());
+    std::vector<uint32_t> applies(transition_count());
+    for (size_t i = 0; i < transition_count(); ++i) {
+        const Transition transition = this->transition(i);
+        rules[transition.state].push_back(i);
+        applies[i] = static_cast<uint32_t>(built.code.size());
+        built.code.push_back(Instruction{nullptr, Opcode::Apply, 0,
+                                         static_cast<uint32_t>(built.actions.size()), 0,
+                                         static_cast<uint32_t>(transition.next_state)});
+        built.actions.insert(built.actions.end(), transition.new_str,
+                             transition.new_str + tape_number);
+        built.actions.insert(built.actions.end(), transition.direction,
+                             transition.direction + tape_number);
+    }
+
+    auto branch = [&built, &symbols](size_t tape) {
+        uint32_t index = static_cast<uint32_t>(built.code.size());
+        built.code.push_back(Instruction{nullptr, Opcode::Branch, static_cast<uint32_t>(tape),
+                                         static_cast<uint32_t>(built.targets.size()), 0, 0});
+        built.targets.resize(built.targets.size() + symbols.size(), 0);
+        return index;
+    };
+
+    // The branches of a state form a tree with one level per tape. Rules are added in file
+    // order and never replace a target, so the first matching rule wins as in
+    // find_transition(). A '*' matches every symbol but the blank.
+    built.blocks.assign(states.size(), 0);
+    if (size() > limit)
+        return;
+    std::vector<uint32_t> nodes{};
+    std::vector<uint32_t> children{};
+    for (size_t state = 0; state < states.size(); ++state) {
+        if (rules[state].empty())
+            continue;
+        built.blocks[state] = branch(0);
+        if (size() > limit)
+            return;
+
+        for (size_t rule : rules[state]) {
+            const char *read = transition(rule).old_str;
+            nodes.assign(1, built.blocks[state]);
+            for (size_t tape = 0; tape < tape_number; ++tape) {
+                bool wildcard = read[tape] == '*';
+                size_t first = wildcard ? 1 : built.ids[static_cast<unsigned char>(read[tape])];
+                size_t last = wildcard ? symbols.size() : first + 1;
+
+                children.clear();
+                for (uint32_t node : nodes) {
+                    for (size_t id = first; id < last; ++id) {
+                        size_t target = built.code[node].operand + id;
+                        if (tape + 1 == tape_number) {
+                            if (built.targets[target] == 0)
+                                built.targets[target] = applies[rule];
+                            continue;
+                        }
+                        if (built.targets[target] == 0) {
+                            uint32_t child = branch(tape + 1);
+                            if (size() > limit || built.code.size() >= 0xffffffff)
+                                return;
+                            built.targets[target] = child;
+                        }
+                        children.push_back(built.targets[target]);
+                    }
+                }
+                nodes.swap(children);
+            }
+        }
+    }
+
+    for (Instruction &instruction : built.code) {
+        if (instruction.opcode == Opcode::Apply)
+            instruction.next = built.blocks[instruction.state];
+    }
+
+    size_t steps = 0;
+    size_t state = 0;
+    execute(built, nullptr, state, steps, nullptr, &built);
+    program = std::move(built);
+}
+
+} // namespace fla
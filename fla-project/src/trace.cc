@@ -0,0 +1,184 @@
+#include <fla/pda.h>
+#include <fla/source.h>
+#include <fla/tm.h>
+#include <fla/trace.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace fla {
+
+TraceWriter::TraceWriter(const std::string &filepath, size_t buffer_size)
+    : _out(filepath, std::ios::binary), _buffer(std::max<size_t>(buffer_size, 1)) {
+    bytes(trace_magic, sizeof(trace_magic));
+    byte(trace_version);
+}
+
+void TraceWriter::run(char kind, const SymbolTable &states) {
+    byte(trace_run);
+    byte(kind);
+    size(states.size());
+    for (size_t i = 0; i < states.size(); ++i)
+        string(states.name(i));
+}
+
+void TraceWriter::flush() {
+    if (_used == 0)
+        return;
+    _out.write(_buffer.data(), static_cast<std::streamsize>(_used));
+    _used = 0;
+}
+
+namespace {
+
+// Reads a trace in place, every read throws std::out_of_range past the end of the data
+class TraceReader {
+  public:
+    TraceReader(const char *data, size_t size) : _data(data), _size(size) {};
+
+    bool done() const { return _offset == _size; };
+    // A count of items that take at least a byte each, checked against the bytes left
+    size_t count() {
+        size_t count = size();
+        if (count > _size - _offset)
+            throw std::out_of_range("truncated trace");
+        return count;
+    };
+    char peek() const {
+        if (done())
+            throw std::out_of_range("truncated trace");
+        return _data[_offset];
+    };
+    char byte() {
+        char value = peek();
+        _offset++;
+        return value;
+    };
+    size_t size() {
+        size_t value = 0;
+        for (size_t shift = 0; shift < 64; shift += 7) {
+            unsigned char part = static_cast<unsigned char>(byte());
+            value |= static_cast<size_t>(part & 0x7f) << shift;
+            if ((part & 0x80) == 0)
+                return value;
+        }
+        throw std::out_of_range("invalid size");
+    };
+    std::string string() {
+        size_t size = this->size();
+        if (size > _size - _offset)
+            throw std::out_of_range("truncated trace");
+        _offset += size;
+        return std::string(_data + _offset - size, size);
+    };
+
+  private:
+    const char *_data;
+    size_t _size;
+    size_t _offset = 0;
+};
+
+// The next state of a step, which must be one of the `states`
+size_t read_state(TraceReader &trace, const std::vector<std::string> &states) {
+    size_t state = trace.size();
+    if (state >= states.size())
+        throw std::out_of_range("invalid state");
+    return state;
+}
+
+void render_pda(TraceReader &trace, const std::vector<std::string> &states, std::ostream &out) {
+    if (trace.byte() != 0) // streamed inputs are not recorded
+        out << "Input: " << trace.string() << '\n';
+    out << "==================== RUN ====================\n";
+    std::vector<char> stack = {trace.byte()};
+    size_t state = read_state(trace, states);
+
+    size_t step = 0;
+    PDASimulator::print_step(out, step, states[state], stack);
+    while (!trace.done() && trace.peek() == trace_step) {
+        trace.byte();
+        state = read_state(trace, states);
+        trace.byte(); // the input symbol read, '_' for none
+        size_t push = trace.size();
+        if (stack.empty())
+            throw std::out_of_range("empty stack");
+        stack.pop_back();
+        for (size_t i = 0; i < push; ++i)
+            stack.push_back(trace.byte());
+        PDASimulator::print_step(out, ++step, states[state], stack);
+    }
+
+    if (!trace.done() && trace.peek() == trace_end) {
+        trace.byte();
+        out << "Result: " << (trace.byte() != 0 ? "true" : "false") << '\n';
+        out << "==================== END ====================\n";
+    }
+}
+
+void render_tm(TraceReader &trace, const std::vector<std::string> &states, std::ostream &out) {
+    std::vector<Tape> tapes(trace.count());
+    if (tapes.empty())
+        throw std::out_of_range("no tapes");
+    std::string input = trace.string();
+    tapes[0].init(input);
+    size_t state = read_state(trace, states);
+    out << "Input: " << input << '\n';
+    out << "==================== RUN ====================\n";
+
+    size_t step = 0;
+    TMSimulator::print_step(out, step, states[state], tapes);
+    while (!trace.done() && trace.peek() == trace_step) {
+        trace.byte();
+        state = read_state(trace, states);
+        for (Tape &tape : tapes) {
+            char symbol = trace.byte();
+            char direction = trace.byte();
+            if (direction != 'l' && direction != 'r' && direction != '*')
+                throw std::out_of_range("invalid direction");
+            tape.step(symbol, direction);
+        }
+        TMSimulator::print_step(out, ++step, states[state], tapes);
+    }
+
+    if (!trace.done() && trace.peek() == trace_end) {
+        trace.byte();
+        out << "Result: " << tapes[0].to_string() << '\n';
+        out << "==================== END ====================\n";
+    }
+}
+
+} // namespace
+
+bool render_trace(const std::string &filepath, std::ostream &out) {
+    SourceFile source(filepath);
+    if (!source.is_open() || source.size() < sizeof(trace_magic) + 1 ||
+        std::memcmp(source.data(), trace_magic, sizeof(trace_magic)) != 0 ||
+        source.data()[sizeof(trace_magic)] != trace_version)
+        return false;
+
+    TraceReader trace(source.data() + sizeof(trace_magic) + 1,
+                      source.size() - sizeof(trace_magic) - 1);
+    try {
+        while (!trace.done()) { // a run without an end record stopped on an error
+            if (trace.byte() != trace_run)
+                return false;
+            char kind = trace.byte();
+            std::vector<std::string> states(trace.count());
+            for (std::string &state : states)
+                state = trace.string();
+
+            if (kind == 'P')
+                render_pda(trace, states, out);
+            else if (kind == 'T')
+                render_tm(trace, states, out);
+            else
+                return false;
+        }
+    } catch (const std::out_of_range &) {
+        return false;
+    }
+    return true;
+}
+
+} // namespace fla
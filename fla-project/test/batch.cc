@@ -0,0 +1,64 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <fla/batch.h>
+#include <fla/pda.h>
+#include <fla/tm.h>
+
+TEST_CASE("batch run test", "[batch]") {
+    fla::TMSimulator tm{};
+    tm.parse(FLA_SOURCE_DIR "/tm/case1.tm");
+
+    std::vector<std::string> inputs{};
+    for (size_t n = 1; n < 20; ++n)
+        inputs.push_back(std::string(n, 'a') + std::string(20 - n, 'b'));
+    inputs.push_back("abc");
+
+    fla::BatchRunner runner(tm, 4);
+    REQUIRE(runner.jobs() == 4);
+
+    std::vector<fla::BatchResult> results = runner.run(inputs);
+    REQUIRE(results.size() == inputs.size());
+    for (size_t n = 1; n < 20; ++n) {
+        REQUIRE(results[n - 1].error == fla::Error::None);
+        REQUIRE(results[n - 1].result.output == std::string(n * (20 - n), 'c'));
+    }
+    REQUIRE(results.back().error == fla::Error::InputError);
+
+    // Runners are reusable and work with fewer inputs than jobs
+    results = runner.run({"ab"});
+    REQUIRE(results.size() == 1);
+    REQUIRE(results[0].result.output == "c");
+    REQUIRE(runner.run({}).empty());
+}
+
+TEST_CASE("batch stream test", "[batch]") {
+    fla::PDASimulator pda{};
+    pda.parse(FLA_SOURCE_DIR "/pda/anbn.pda");
+    fla::BatchRunner runner(pda, 3);
+
+    // More inputs than the window holds, with long ones in between, come back in order
+    const size_t count = 10000;
+    auto input = [](size_t i) {
+        size_t n = i % 1000 == 7 ? 100000 : i % 20;
+        return std::string(n, 'a') + std::string(n + i % 2, 'b');
+    };
+    size_t read = 0;
+    size_t done = 0;
+    runner.run(
+        [&read, &input](std::string &next) {
+            if (read == count)
+                return false;
+            next = input(read++);
+            return true;
+        },
+        [&done](const fla::BatchResult &result) {
+            REQUIRE(result.error == fla::Error::None);
+            REQUIRE(result.result.accept == (done % 2 == 0 && done % 20 != 0));
+            done++;
+        });
+    REQUIRE(done == count);
+
+    // The workers stay for the next run
+    REQUIRE(runner.run({"aabb", "ab", "abb"}).size() == 3);
+    REQUIRE(runner.run({"aabb"})[0].result.accept);
+}
@@ -0,0 +1,125 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <fla/pda.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+
+namespace {
+
+std::atomic<size_t> allocations{0};
+
+} // namespace
+
+// Counts the heap allocations of the whole test binary
+void *operator new(size_t size) {
+    allocations++;
+    if (void *p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+TEST_CASE("pda run test", "[pda]") {
+    fla::PDASimulator pda{};
+    pda.parse(FLA_SOURCE_DIR "/pda/anbn.pda");
+
+    fla::Result result = pda.run("aabb");
+    REQUIRE(result.accept);
+    REQUIRE(result.output == "true");
+    REQUIRE(result.reason == fla::HaltReason::Accept);
+    REQUIRE(result.steps == 5);
+
+    // The simulator is reusable after a run
+    result = pda.run("aab");
+    REQUIRE(!result.accept);
+    REQUIRE(result.output == "false");
+    REQUIRE(result.reason == fla::HaltReason::NoTransition);
+
+    result = pda.run("ab");
+    REQUIRE(result.accept);
+    REQUIRE(result.steps == 3);
+
+    REQUIRE_THROWS_AS(pda.run("abc"), fla::Error);
+    REQUIRE(pda.run("aaabbb").accept);
+}
+
+TEST_CASE("pda limits test", "[pda]") {
+    fla::PDASimulator pda{};
+    pda.parse(FLA_SOURCE_DIR "/pda/loop.pda");
+
+    // A run cut off by a limit keeps its partial statistics
+    pda.set_max_steps(100);
+    fla::Result result = pda.run("ab");
+    REQUIRE(!result.accept);
+    REQUIRE(result.reason == fla::HaltReason::Limit);
+    REQUIRE(result.steps == 100);
+
+    pda.set_max_steps(0);
+    pda.set_max_cells(10);
+    result = pda.run("ab");
+    REQUIRE(result.reason == fla::HaltReason::Limit);
+    REQUIRE(result.steps == 10);
+
+    pda.set_max_cells(0);
+    pda.set_timeout(std::chrono::milliseconds(10));
+    REQUIRE(pda.run("ab").reason == fla::HaltReason::Timeout);
+}
+
+TEST_CASE("pda input stream test", "[pda]") {
+    // Chunks of one character still see the whole input and drop the final line break
+    std::istringstream in("aabb\r\n");
+    fla::InputCursor cursor(in, true, 1);
+    std::string read{};
+    for (; !cursor.empty(); cursor.pop())
+        read.push_back(cursor.front());
+    REQUIRE(read == "aabb");
+    REQUIRE(cursor.position() == 4);
+    REQUIRE(!cursor.failed());
+
+    std::string inner("a\nb");
+    fla::InputCursor view(inner.data(), inner.size(), true);
+    for (read.clear(); !view.empty(); view.pop())
+        read.push_back(view.front());
+    REQUIRE(read == inner);
+
+    fla::PDASimulator pda{};
+    pda.parse(FLA_SOURCE_DIR "/pda/anbn.pda");
+
+    std::istringstream accepted(std::string(5000, 'a') + std::string(5000, 'b') + "\n");
+    fla::InputCursor input(accepted, true, 64);
+    fla::Result result = pda.run(input);
+    REQUIRE(result.accept);
+    REQUIRE(result.steps == 10001);
+
+    // Symbols the machine never reads are still checked
+    std::istringstream rejected("aabbbc");
+    fla::InputCursor rest(rejected, false, 2);
+    REQUIRE_THROWS_AS(pda.run(rest), fla::Error);
+    REQUIRE(pda.run("aabb").accept);
+}
+
+TEST_CASE("pda allocation test", "[pda]") {
+    size_t before = allocations;
+    fla::PDASimulator pda{};
+    pda.parse(FLA_SOURCE_DIR "/pda/anbn.pda");
+    REQUIRE(allocations != before); // the counter sees the allocations
+
+    std::string longer = std::string(10000, 'a') + std::string(10000, 'b');
+    std::string shorter = "aabb";
+    REQUIRE(pda.run(longer).accept); // grows the stack once
+
+    // A run allocates the same no matter how many steps it takes
+    before = allocations;
+    REQUIRE(pda.run(shorter).accept);
+    size_t few = allocations - before;
+
+    before = allocations;
+    REQUIRE(pda.run(longer).accept);
+    REQUIRE(allocations - before == few);
+}
@@ -2,6 +2,7 @@
 
 #include <fla/pda.h>
 #include <fla/simulator.h>
+#include <fla/util.h>
 
 namespace fla {
 
@@ -17,3 +18,54 @@ class SimulatorTest {
 } // namespace fla
 
 TEST_CASE("simulator test", "[simulator]") { fla::SimulatorTest::test_verbose(); }
+
+TEST_CASE("symbol table test", "[simulator]") {
+    fla::SymbolTable states{};
+    REQUIRE(states.intern("q0") == 0);
+    REQUIRE(states.intern("q1") == 1);
+    REQUIRE(states.intern("q0") == 0);
+    REQUIRE(states.find("q1") == 1);
+    REQUIRE(states.find("q2") == fla::SymbolTable::npos);
+    REQUIRE(states.name(1) == "q1");
+
+    fla::Alphabet alphabet{};
+    alphabet.add("b");
+    alphabet.add("a");
+    alphabet.add("b");
+    REQUIRE(alphabet.size() == 2);
+    REQUIRE(alphabet.id('b') == 0);
+    REQUIRE(alphabet.id('a') == 1);
+    REQUIRE(alphabet.id('c') == fla::Alphabet::npos);
+    REQUIRE(alphabet.contains('a'));
+    REQUIRE(!alphabet.contains('c'));
+    REQUIRE(!alphabet.contains("ab"));
+
+    // Offsets inside and across the blocks validate() checks at once
+    std::string input(1000, 'a');
+    REQUIRE(alphabet.validate(input) == fla::Alphabet::npos);
+    REQUIRE(alphabet.validate("") == fla::Alphabet::npos);
+    for (size_t offset : std::vector<size_t>{0, 63, 64, 500, 999}) {
+        std::string bad = input;
+        bad[offset] = static_cast<char>(0xff);
+        bad[999] = 'c';
+        REQUIRE(alphabet.validate(bad) == offset);
+    }
+}
+
+TEST_CASE("directive matching test", "[simulator]") {
+    std::string value{};
+    REQUIRE(fla::match_directive("#Q = {q0,q1}", "#Q", true, value));
+    REQUIRE(value == "q0,q1");
+    REQUIRE(fla::match_directive("#q0 = start", "#q0", false, value));
+    REQUIRE(value == "start");
+
+    REQUIRE_FALSE(fla::match_directive("#Q = {}", "#Q", true, value));
+    REQUIRE_FALSE(fla::match_directive("#Q = {a}}", "#Q", true, value));
+    REQUIRE_FALSE(fla::match_directive("#Q={a}", "#Q", true, value));
+    REQUIRE_FALSE(fla::match_directive("#q0 = a b", "#q0", false, value));
+    REQUIRE_FALSE(fla::match_directive("#q0 = ", "#q0", false, value));
+
+    std::vector<std::string> items{};
+    fla::split_whitespace(" q0  a\tb r q1 ", items);
+    REQUIRE(items == std::vector<std::string>{"q0", "a", "b", "r", "q1"});
+}
@@ -0,0 +1,432 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <fla/tm.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fla {
+
+// Finds overlapping rules of q0 in a two-tape NTM over {a,b}, whose rules are not checked
+class TMSimulatorTest {
+  public:
+    explicit TMSimulatorTest(const std::vector<std::string> &reads) {
+        std::string path = std::string(std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp") +
+                           "/fla-test-overlaps.tm";
+        {
+            std::ofstream out(path);
+            out << "#Q = {q0}\n#S = {a,b}\n#G = {a,b,_}\n#q0 = q0\n#B = _\n#F = {q0}\n#N = 2\n";
+            for (const std::string &read : reads)
+                out << "q0 " << read << ' ' << read << " ** q0\n";
+        }
+
+        // the overlap reports are not checked here
+        std::ostringstream reports{};
+        std::streambuf *cerr = std::cerr.rdbuf(reports.rdbuf());
+        _tm.set_nondeterministic(true);
+        _tm.set_check_overlaps(true);
+        _tm.parse(path);
+        std::cerr.rdbuf(cerr);
+        std::remove(path.c_str());
+    }
+
+    std::vector<size_t> overlaps(const std::string &read) const {
+        std::vector<size_t> rules{};
+        _tm.find_overlaps("q0", read, true, rules);
+        return rules;
+    }
+
+    bool covered(const std::string &read, const std::vector<size_t> &rules) const {
+        return _tm.covered(read, rules);
+    }
+
+  private:
+    TMSimulator _tm{};
+};
+
+} // namespace fla
+
+namespace {
+
+// Whether some tape matches both read strings, '*' matching every symbol but the blank
+bool overlap(const std::string &lhs, const std::string &rhs) {
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        if (lhs[i] != rhs[i] && !(lhs[i] == '*' && rhs[i] != '_') &&
+            !(rhs[i] == '*' && lhs[i] != '_'))
+            return false;
+    }
+    return true;
+}
+
+} // namespace
+
+TEST_CASE("tm run test", "[tm]") {
+    fla::TMSimulator tm{};
+    tm.parse(FLA_SOURCE_DIR "/tm/case1.tm");
+
+    fla::Result result = tm.run("aabbb");
+    REQUIRE(result.accept);
+    REQUIRE(result.output == "cccccc");
+    REQUIRE(result.reason == fla::HaltReason::NoTransition);
+
+    // The simulator is reusable after a run
+    result = tm.run("ba");
+    REQUIRE(result.accept);
+    REQUIRE(result.output == "illegal_input");
+
+    REQUIRE(tm.run("ab").output == "c");
+}
+
+TEST_CASE("tape test", "[tm]") {
+    fla::Tape tape{};
+    tape.init("ab");
+    REQUIRE(tape.read() == 'a');
+
+    // Grow past both ends of the buffer
+    for (int i = 0; i < 10; ++i)
+        tape.step('*', 'l');
+    REQUIRE(tape.read() == '_');
+    tape.step('x', 'r');
+    for (int i = 0; i < 30; ++i)
+        tape.step('*', 'r');
+    tape.step('y', '*');
+    REQUIRE(tape.read() == 'y');
+    REQUIRE(tape.to_string() == "x_________ab___________________y");
+
+    // Blanks are only trimmed when the tape is converted
+    tape.step('_', 'l');
+    REQUIRE(tape.to_string() == "x_________ab");
+
+    fla::Tape empty{};
+    empty.init("");
+    empty.step('_', 'r');
+    REQUIRE(empty.to_string().empty());
+}
+
+TEST_CASE("ntm run test", "[tm]") {
+    fla::TMSimulator tm{};
+    tm.set_nondeterministic(true);
+    tm.parse(FLA_SOURCE_DIR "/tm/substring.tm");
+
+    for (auto strategy : {fla::SearchStrategy::BreadthFirst, fla::SearchStrategy::DepthFirst,
+                          fla::SearchStrategy::IterativeDeepening}) {
+        tm.set_search_strategy(strategy);
+
+        fla::Result result = tm.run("bababb");
+        REQUIRE(result.accept);
+        REQUIRE(result.output == "baba");
+        REQUIRE(result.reason == fla::HaltReason::Accept);
+
+        result = tm.run("abba");
+        REQUIRE_FALSE(result.accept);
+        REQUIRE(result.reason == fla::HaltReason::NoTransition);
+    }
+
+    tm.set_max_configurations(2);
+    REQUIRE(tm.run("bbbbaba").reason == fla::HaltReason::Limit);
+}
+
+TEST_CASE("tape hash test", "[tm]") {
+    fla::Tape lhs{};
+    lhs.init("ab");
+    fla::Tape rhs{};
+    rhs.init("a");
+
+    // The same contents and head position, reached along different paths
+    rhs.step('*', 'r');
+    rhs.step('b', 'l');
+    for (int i = 0; i < 5; ++i)
+        rhs.step('*', 'l');
+    for (int i = 0; i < 5; ++i)
+        rhs.step('*', 'r');
+    REQUIRE(lhs.hash() == rhs.hash());
+    REQUIRE(lhs == rhs);
+
+    rhs.step('*', 'r');
+    REQUIRE_FALSE(lhs == rhs);
+    lhs.step('c', 'r');
+    REQUIRE(lhs.hash() != rhs.hash());
+    REQUIRE_FALSE(lhs == rhs);
+}
+
+TEST_CASE("tm image test", "[tm]") {
+    fla::TMSimulator tm{};
+    tm.parse(FLA_SOURCE_DIR "/tm/palindrome_detector_2tapes.tm");
+    std::string path = std::string(std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp") +
+                       "/fla-test-palindrome.tmc";
+    tm.save(path);
+
+    fla::TMSimulator loaded{};
+    loaded.load(path);
+    for (const char *input : {"", "1", "1001", "10011", "100101"}) {
+        fla::Result expected = tm.run(input);
+        fla::Result result = loaded.run(input);
+        REQUIRE(result.output == expected.output);
+        REQUIRE(result.steps == expected.steps);
+        REQUIRE(result.accept == expected.accept);
+    }
+    std::remove(path.c_str());
+
+    REQUIRE_THROWS_AS(loaded.load(FLA_SOURCE_DIR "/tm/case1.tm"), fla::Error);
+}
+
+TEST_CASE("tm engine test", "[tm]") {
+    const char *machines[][2] = {
+        {FLA_SOURCE_DIR "/tm/case1.tm", "ab"},
+        {FLA_SOURCE_DIR "/tm/case2.tm", "1"},
+        {FLA_SOURCE_DIR "/tm/palindrome_detector_2tapes.tm", "01"},
+        {FLA_SOURCE_DIR "/tm/wildcard.tm", "ab"},
+    };
+    for (const auto &machine : machines) {
+        // Plain runs go through the threaded program, runs with cycle detection through the
+        // dense table and every run through the general engine without tables
+        fla::TMSimulator threaded{};
+        threaded.parse(machine[0]);
+        fla::TMSimulator dense{};
+        dense.set_detect_cycles(true);
+        dense.parse(machine[0]);
+        fla::TMSimulator general{};
+        general.set_table_limit(0);
+        general.parse(machine[0]);
+
+        // Every input up to 6 symbols
+        std::string symbols = machine[1];
+        std::vector<std::string> inputs = {""};
+        for (size_t i = 0; i < inputs.size() && inputs[i].size() < 6; ++i) {
+            for (char symbol : symbols)
+                inputs.push_back(inputs[i] + symbol);
+        }
+        for (const std::string &input : inputs) {
+            fla::Result expected = general.run(input);
+            for (fla::TMSimulator *tm : {&threaded, &dense}) {
+                fla::Result result = tm->run(input);
+                REQUIRE(result.output == expected.output);
+                REQUIRE(result.steps == expected.steps);
+                REQUIRE(result.accept == expected.accept);
+            }
+        }
+    }
+
+    // The threaded program stops at the same step as the general engine
+    fla::TMSimulator threaded{};
+    threaded.parse(FLA_SOURCE_DIR "/tm/loop.tm");
+    fla::TMSimulator general{};
+    general.set_table_limit(0);
+    general.parse(FLA_SOURCE_DIR "/tm/loop.tm");
+    for (fla::TMSimulator *tm : {&threaded, &general}) {
+        tm->set_max_steps(0);
+        tm->set_max_cells(10);
+        fla::Result result = tm->run("aaaa");
+        REQUIRE(result.reason == fla::HaltReason::Limit);
+        REQUIRE(result.steps == 10);
+
+        tm->set_max_steps(7);
+        tm->set_max_cells(0);
+        result = tm->run("aaaa");
+        REQUIRE(result.reason == fla::HaltReason::Limit);
+        REQUIRE(result.steps == 7);
+    }
+}
+
+TEST_CASE("tm profile test", "[tm]") {
+    // The threaded program and the general engine count the same rule fires
+    fla::TMSimulator threaded{};
+    threaded.set_profile(true);
+    threaded.parse(FLA_SOURCE_DIR "/tm/palindrome_detector_2tapes.tm");
+    fla::TMSimulator general{};
+    general.set_profile(true);
+    general.set_table_limit(0);
+    general.parse(FLA_SOURCE_DIR "/tm/palindrome_detector_2tapes.tm");
+
+    for (const std::string input : {"", "0", "1001001", "10011"}) {
+        fla::Result result = threaded.run(input);
+        fla::RunStats stats = threaded.stats();
+        general.run(input);
+        REQUIRE(stats.fires == general.stats().fires);
+        REQUIRE(stats.visits == general.stats().visits);
+        REQUIRE(stats.rules == general.stats().rules);
+
+        uint64_t fires = 0;
+        for (uint64_t count : stats.fires)
+            fires += count;
+        uint64_t visits = 0;
+        for (uint64_t count : stats.visits)
+            visits += count;
+        REQUIRE(fires == result.steps);
+        REQUIRE(visits == result.steps + 1);
+        REQUIRE(stats.tape_cells.size() == 2);
+        REQUIRE(stats.tape_cells[0] >= std::max<size_t>(input.size(), 1));
+    }
+
+    // Without profiling only the cells are recorded
+    fla::TMSimulator plain{};
+    plain.parse(FLA_SOURCE_DIR "/tm/case1.tm");
+    plain.run("aabb");
+    REQUIRE(plain.stats().fires.empty());
+    REQUIRE(plain.stats().tape_cells.size() == 3);
+}
+
+TEST_CASE("tm macro step test", "[tm]") {
+    fla::TMSimulator plain{};
+    plain.parse(FLA_SOURCE_DIR "/tm/unary_double.tm");
+    fla::TMSimulator macro{};
+    macro.parse(FLA_SOURCE_DIR "/tm/unary_double.tm");
+
+    for (size_t width : std::vector<size_t>{1, 2, 3, 8}) {
+        macro.set_macro_block(width);
+        for (size_t n = 0; n < 40; n += 3) {
+            std::string input(n, '1');
+            fla::Result expected = plain.run(input);
+            fla::Result result = macro.run(input);
+            REQUIRE(result.output == std::string(2 * n, '1'));
+            REQUIRE(result.output == expected.output);
+            REQUIRE(result.steps == expected.steps);
+            REQUIRE(result.accept == expected.accept);
+        }
+
+        // Limits stop the run at the same step
+        for (fla::TMSimulator *tm : {&plain, &macro}) {
+            tm->set_max_steps(0);
+            tm->set_max_cells(30);
+        }
+        fla::Result expected = plain.run(std::string(20, '1'));
+        fla::Result result = macro.run(std::string(20, '1'));
+        REQUIRE(result.reason == fla::HaltReason::Limit);
+        REQUIRE(result.steps == expected.steps);
+        REQUIRE(result.output == expected.output);
+
+        for (fla::TMSimulator *tm : {&plain, &macro}) {
+            tm->set_max_steps(777);
+            tm->set_max_cells(0);
+        }
+        expected = plain.run(std::string(20, '1'));
+        result = macro.run(std::string(20, '1'));
+        REQUIRE(result.reason == fla::HaltReason::Limit);
+        REQUIRE(result.steps == 777);
+        REQUIRE(result.output == expected.output);
+        plain.set_max_steps(0);
+        macro.set_max_steps(0);
+    }
+}
+
+TEST_CASE("run-length tape test", "[tm]") {
+    fla::RunLengthTape tape{};
+    tape.init("aaabbb");
+    REQUIRE(tape.runs() == 2);
+    REQUIRE(tape.read() == 'a');
+
+    // Writing in the middle of a run splits it, writing the neighbour's symbol merges
+    tape.step('*', 'r');
+    tape.step('c', 'r');
+    REQUIRE(tape.runs() == 4);
+    REQUIRE(tape.to_string() == "acabbb");
+    tape.step('b', 'l');
+    REQUIRE(tape.runs() == 3);
+    tape.step('a', '*');
+    REQUIRE(tape.runs() == 2);
+    REQUIRE(tape.to_string() == "aabbbb");
+
+    // Blanks past both ends join one run
+    for (int i = 0; i < 10; ++i)
+        tape.step('*', 'l');
+    REQUIRE(tape.read() == '_');
+    REQUIRE(tape.runs() == 3);
+    tape.step('x', 'r');
+    REQUIRE(tape.to_string() == "x________aabbbb");
+    REQUIRE(tape.size() == 15);
+    for (int i = 0; i < 20; ++i)
+        tape.step('*', 'r');
+    tape.step('y', '*');
+    REQUIRE(tape.to_string() == "x________aabbbb______y");
+    tape.step('_', 'l');
+    REQUIRE(tape.to_string() == "x________aabbbb");
+
+    fla::RunLengthTape empty{};
+    empty.init("");
+    empty.step('_', 'r');
+    REQUIRE(empty.to_string().empty());
+
+    // Runs on both tape backends agree
+    const char *machines[] = {FLA_SOURCE_DIR "/tm/case1.tm", FLA_SOURCE_DIR "/tm/unary_double.tm"};
+    for (const char *machine : machines) {
+        fla::TMSimulator flat{};
+        flat.parse(machine);
+        fla::TMSimulator rle{};
+        rle.set_tape_backend(fla::TapeBackend::RunLength);
+        rle.parse(machine);
+        fla::TMSimulator general{};
+        general.set_table_limit(0);
+        general.set_tape_backend(fla::TapeBackend::RunLength);
+        general.parse(machine);
+        for (const char *input : {"", "ab", "aabbb", "ba", "1", "111111"}) {
+            fla::TMSimulator *tms[] = {&flat, &rle, &general};
+            std::vector<fla::Result> results{};
+            for (fla::TMSimulator *tm : tms) {
+                try {
+                    results.push_back(tm->run(input));
+                } catch (const fla::Error &) {
+                    results.push_back(fla::Result{false, "error", 0, fla::HaltReason::Limit});
+                }
+            }
+            for (const fla::Result &result : results) {
+                REQUIRE(result.output == results[0].output);
+                REQUIRE(result.steps == results[0].steps);
+            }
+        }
+    }
+}
+
+TEST_CASE("tm overlap test", "[tm]") {
+    // One exact rule, so the matches of "**" are not looked up but the rules scanned
+    REQUIRE(fla::TMSimulatorTest({"ab", "**"}).overlaps("**") == std::vector<size_t>{0, 1});
+    // Five exact rules, so the four matches of "**" are looked up. '*' does not match a blank.
+    fla::TMSimulatorTest exact({"aa", "ab", "ba", "bb", "a_"});
+    REQUIRE(exact.overlaps("**") == std::vector<size_t>{0, 1, 2, 3});
+    REQUIRE(exact.overlaps("*_") == std::vector<size_t>{4});
+    REQUIRE(exact.overlaps("_*").empty());
+    fla::TMSimulatorTest blanks({"_a", "*_", "__"});
+    REQUIRE(blanks.overlaps("*a").empty());
+    REQUIRE(blanks.overlaps("_*") == std::vector<size_t>{0});
+    REQUIRE(blanks.overlaps("a_") == std::vector<size_t>{1});
+
+    // Both lookups agree with comparing every pair, duplicate rules included
+    std::vector<std::string> reads{};
+    for (char first : std::string("ab_*"))
+        for (char second : std::string("ab_*"))
+            reads.push_back(std::string{first, second});
+    std::shuffle(reads.begin(), reads.end(), std::mt19937(5));
+    for (size_t size = 1; size <= reads.size(); ++size) {
+        std::vector<std::string> rules(reads.begin(), reads.begin() + static_cast<long>(size));
+        for (size_t copies = 1; copies <= 2; ++copies) {
+            std::vector<std::string> machine{};
+            for (size_t i = 0; i < copies; ++i)
+                machine.insert(machine.end(), rules.begin(), rules.end());
+            fla::TMSimulatorTest tm(machine);
+            for (const std::string &query : reads) {
+                std::vector<size_t> expected{};
+                for (size_t i = 0; i < machine.size(); ++i) {
+                    if (overlap(machine[i], query))
+                        expected.push_back(i);
+                }
+                REQUIRE(tm.overlaps(query) == expected);
+            }
+        }
+    }
+
+    // Whether the rules match every tape the read string matches
+    fla::TMSimulatorTest cover({"aa", "ba", "a*", "b*", "**", "_a"});
+    REQUIRE(cover.covered("*a", {0, 1}));
+    REQUIRE_FALSE(cover.covered("*a", {0}));
+    REQUIRE(cover.covered("**", {2, 3}));
+    REQUIRE_FALSE(cover.covered("**", {0, 1, 2}));
+    REQUIRE(cover.covered("ab", {4}));
+    REQUIRE_FALSE(cover.covered("_a", {4}));
+    REQUIRE(cover.covered("_a", {5}));
+}
@@ -1,7 +1,14 @@
+import itertools
+import json
+import os
+import shutil
 import subprocess
 import pytest
 
-from util import EXIT_SUCCESS, EXIT_FAILURE, HELP_INFO, EXEC_PATH
+from util import EXIT_SUCCESS, EXIT_FAILURE, HELP_INFO, ROOT_DIR, run_fla
+
+TM_DIR = os.path.join(ROOT_DIR, "tm/")
+PDA_DIR = os.path.join(ROOT_DIR, "pda/")
 
 
 class TestInterface:
@@ -25,7 +32,7 @@ class TestInterface:
         ],
     )
     def test_options(self, args, returncode, stderr):
-        result = subprocess.run([EXEC_PATH] + args, capture_output=True, text=True)
+        result = run_fla(args)
         assert result.returncode == returncode
         assert result.stdout == ""
         assert result.stderr == stderr
@@ -47,7 +54,427 @@ class TestInterface:
         ],
     )
     def test_args(self, args, returncode, stderr):
-        result = subprocess.run([EXEC_PATH] + args, capture_output=True, text=True)
+        result = run_fla(args)
         assert result.returncode == returncode
         assert result.stdout == ""
         assert result.stderr == stderr
+
+
+class TestBatch:
+    PDA = PDA_DIR + "anbn.pda"
+    TM = TM_DIR + "case1.tm"
+
+    def test_stdin(self):
+        result = run_fla(
+            ["--batch", self.PDA],
+            input="ab\naab\n\naaabbb\n",
+        )
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stdout == "true\nfalse\nfalse\ntrue\n"
+        assert result.stderr == ""
+
+    def test_file(self, tmp_path):
+        inputs = tmp_path / "inputs.txt"
+        inputs.write_text("ab\nabc\naabbb\n")
+        result = run_fla(["-b", self.TM, str(inputs)])
+        assert result.returncode == EXIT_FAILURE
+        assert result.stdout == "c\nillegal input\ncccccc\n"
+        assert result.stderr == "illegal input\n"
+
+    def test_missing_file(self):
+        result = run_fla(["-b", self.TM, "missing.txt"])
+        assert result.returncode == EXIT_FAILURE
+        assert result.stdout == ""
+        assert result.stderr == "Could not open the file: missing.txt\n"
+
+    @pytest.mark.parametrize("jobs", ["0", "1", "4"])
+    def test_jobs(self, jobs):
+        inputs = ["a" * n + "b" * m for n in range(1, 30) for m in range(1, 30)]
+        expected = ["true" if n == m else "false" for n in range(1, 30) for m in range(1, 30)]
+        result = run_fla(
+            ["-b", "-j", jobs, self.PDA],
+            input="\n".join(inputs) + "\n",
+        )
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stdout.splitlines() == expected
+        assert result.stderr == ""
+
+    @pytest.mark.parametrize("jobs", ["-1", "x", "2x"])
+    def test_invalid_jobs(self, jobs):
+        result = run_fla(["-b", "--jobs", jobs, self.PDA])
+        assert result.returncode == EXIT_FAILURE
+        assert result.stdout == ""
+        assert result.stderr == "Invalid value for option: --jobs\n" + HELP_INFO
+
+
+class TestLimits:
+    PDA = PDA_DIR + "loop.pda"
+    TM = TM_DIR + "loop.tm"
+    ANBN = PDA_DIR + "anbn.pda"
+
+    @pytest.mark.parametrize(
+        "args, stdout",
+        [
+            (["--max-steps", "1000", PDA, "ab"], "limit\n"),
+            (["--max-cells", "1000", PDA, "ab"], "limit\n"),
+            (["--timeout", "100", PDA, "ab"], "timeout\n"),
+            (["--max-steps", "1000", TM, "aa"], "limit\n"),
+            (["--max-cells", "1000", TM, "aa"], "limit\n"),
+            (["--timeout", "100", TM, "aa"], "timeout\n"),
+            (["-n", "--max-configs", "0", "--max-steps", "1000", PDA, "ab"], "limit\n"),
+            (["-n", "--max-configs", "0", "--timeout", "100", TM, "aa"], "timeout\n"),
+            # runs that halt in time are not affected
+            (["--max-steps", "5", "--timeout", "1000", ANBN, "aabb"], "true\n"),
+            (["--max-cells", "3", TM, "aab"], "aab\n"),
+        ],
+    )
+    def test_limits(self, args, stdout):
+        result = run_fla(args)
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stdout == stdout
+        assert result.stderr == ""
+
+    def test_batch(self):
+        # A runaway input does not hold back the others
+        result = run_fla(
+            ["-b", "-j", "2", "--timeout", "100", self.TM],
+            input="a\nab\nb\n",
+            timeout=5,
+        )
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stdout == "timeout\nab\nb\n"
+        assert result.stderr == ""
+
+    @pytest.mark.parametrize(
+        "machine, input, stdout",
+        [
+            ("tm/cycle.tm", "a", "loop\n"),
+            ("tm/cycle.tm", "ab", "loop\n"),
+            ("tm/cycle.tm", "ba", "ba\n"),
+            ("pda/cycle.pda", "ab", "loop\n"),
+            ("pda/cycle.pda", "b", "false\n"),
+            # a stack that keeps growing is a loop as well
+            ("pda/loop.pda", "ab", "loop\n"),
+            ("pda/anbn.pda", "aabb", "true\n"),
+        ],
+    )
+    def test_detect_loops(self, machine, input, stdout):
+        machine = os.path.join(ROOT_DIR, machine)
+        result = run_fla(["--detect-loops", machine, input])
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stdout == stdout
+        assert result.stderr == ""
+
+    @pytest.mark.parametrize("search", ["bfs", "dfs", "iddfs"])
+    def test_nondeterministic_loop(self, search):
+        # every branch only repeats configurations it has been in
+        machine = TM_DIR + "cycle.tm"
+        result = run_fla(["-n", "--search", search, machine, "ab"])
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stdout == "loop\n"
+        assert result.stderr == ""
+
+    def test_moving_loop(self):
+        # Only exact repeats are loops, a head that walks away for ever is not
+        result = run_fla(["--detect-loops", "--max-steps", "10000", self.TM, "aa"])
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stdout == "limit\n"
+        assert result.stderr == ""
+
+
+class TestCompile:
+    @pytest.mark.parametrize(
+        "flags, machine, inputs",
+        [
+            ([], "pda/anbn.pda", {"aabb": "true", "aab": "false", "": "false"}),
+            ([], "tm/case1.tm", {"aabbb": "cccccc", "ba": "illegal_input"}),
+            (["-n"], "pda/palindrome.pda", {"abba": "true", "aba": "false"}),
+            (["-n"], "tm/substring.tm", {"ababb": "aba", "abba": "abba"}),
+        ],
+    )
+    def test_compile(self, tmp_path, flags, machine, inputs):
+        image = tmp_path / (os.path.basename(machine) + "c")
+        machine = os.path.join(ROOT_DIR, machine)
+        result = run_fla(flags + ["compile", machine, "-o", str(image)])
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stdout == ""
+        assert result.stderr == ""
+
+        for input, output in inputs.items():
+            result = run_fla([str(image), input])
+            assert result.returncode == EXIT_SUCCESS
+            assert result.stdout == output + "\n"
+            assert result.stderr == ""
+
+    def test_default_output(self, tmp_path):
+        machine = tmp_path / "anbn.pda"
+        machine.write_text(open(os.path.join(ROOT_DIR, "pda/anbn.pda")).read())
+        result = run_fla(["compile", str(machine)])
+        assert result.returncode == EXIT_SUCCESS
+        assert (tmp_path / "anbn.pdac").exists()
+
+    def test_illegal_input(self, tmp_path):
+        image = tmp_path / "anbn.pdac"
+        machine = os.path.join(ROOT_DIR, "pda/anbn.pda")
+        run_fla(["compile", machine, "-o", str(image)])
+        result = run_fla([str(image), "abc"])
+        assert result.returncode == EXIT_FAILURE
+        assert result.stdout == ""
+        assert result.stderr == "illegal input\n"
+
+    @pytest.mark.parametrize("contents", [b"", b"FLAC", b"not an image at all"])
+    def test_invalid_image(self, tmp_path, contents):
+        image = tmp_path / "broken.tmc"
+        image.write_bytes(contents)
+        result = run_fla(["-v", str(image), "a"])
+        assert result.returncode == EXIT_FAILURE
+        assert result.stdout == ""
+        assert "Invalid compiled machine" in result.stderr
+
+    def test_kind_mismatch(self, tmp_path):
+        # A PDA image can not be loaded as a TM
+        image = tmp_path / "anbn.tmc"
+        machine = os.path.join(ROOT_DIR, "pda/anbn.pda")
+        run_fla(["compile", machine, "-o", str(image)])
+        result = run_fla([str(image), "ab"])
+        assert result.returncode == EXIT_FAILURE
+        assert result.stdout == ""
+        assert result.stderr == ""
+
+
+@pytest.mark.skipif(shutil.which("c++") is None, reason="needs a C++ compiler")
+class TestCodegen:
+    def build(self, tmp_path, machine):
+        source = tmp_path / "simulator.cc"
+        binary = tmp_path / "simulator"
+        result = run_fla(["codegen", os.path.join(ROOT_DIR, machine), "-o", str(source)])
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stderr == ""
+        subprocess.run(["c++", "-std=c++14", "-o", str(binary), str(source)], check=True)
+        return str(binary)
+
+    @pytest.mark.parametrize(
+        "machine, symbols",
+        [
+            ("tm/case1.tm", "ab"),
+            ("tm/case2.tm", "1"),
+            ("tm/palindrome_detector_2tapes.tm", "01"),
+            ("tm/wildcard.tm", "ab"),
+            ("tm/cycle.tm", "ab"),
+        ],
+    )
+    def test_differential(self, tmp_path, machine, symbols):
+        binary = self.build(tmp_path, machine)
+
+        # Every input up to 6 symbols and a few illegal ones, in batch and single runs
+        inputs = [
+            "".join(p) for n in range(7) for p in itertools.product(symbols, repeat=n)
+        ] + ["x", symbols + "c"]
+        flags = ["--max-steps", "200"]
+        expected = run_fla(
+            flags + ["-b", os.path.join(ROOT_DIR, machine)],
+            input="\n".join(inputs) + "\n",
+        )
+        result = subprocess.run(
+            [binary] + flags + ["-b"], input="\n".join(inputs) + "\n", capture_output=True, text=True
+        )
+        assert result.stdout == expected.stdout
+        assert result.stderr == expected.stderr
+        assert result.returncode == expected.returncode
+
+        for input in inputs[:8] + inputs[-2:]:
+            expected = run_fla(flags + [os.path.join(ROOT_DIR, machine), input])
+            result = subprocess.run([binary] + flags + [input], capture_output=True, text=True)
+            assert (result.stdout, result.stderr, result.returncode) == (
+                expected.stdout,
+                expected.stderr,
+                expected.returncode,
+            )
+
+    def test_default_output(self, tmp_path):
+        machine = tmp_path / "case1.tm"
+        machine.write_text(open(os.path.join(ROOT_DIR, "tm/case1.tm")).read())
+        result = run_fla(["codegen", str(machine)])
+        assert result.returncode == EXIT_SUCCESS
+        assert (tmp_path / "case1_sim.cc").exists()
+
+    def test_pda(self):
+        machine = os.path.join(ROOT_DIR, "pda/anbn.pda")
+        result = run_fla(["codegen", machine])
+        assert result.returncode == EXIT_FAILURE
+        assert result.stderr == "Only '*.tm' files can be generated: " + machine + "\n"
+
+
+class TestTrace:
+    @pytest.mark.parametrize(
+        "flags, machine, input",
+        [
+            ([], "pda/anbn.pda", "aaabbb"),
+            ([], "pda/anbn.pda", "aab"),
+            ([], "tm/palindrome_detector_2tapes.tm", "1001001"),
+            ([], "tm/unary_double.tm", "111"),
+            (["--max-steps", "5"], "tm/case1.tm", "aabb"),
+            (["--tape", "rle"], "tm/wildcard.tm", "abab"),
+        ],
+    )
+    def test_render(self, tmp_path, flags, machine, input):
+        machine = os.path.join(ROOT_DIR, machine)
+        trace = tmp_path / "run.trace"
+        expected = run_fla(["-v"] + flags + [machine, input])
+
+        result = run_fla(["--trace", str(trace)] + flags + [machine, input])
+        assert result.returncode == EXIT_SUCCESS
+
+        # the rendered trace is what -v prints
+        result = run_fla(["trace-render", str(trace)])
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stdout == expected.stdout
+
+        output = tmp_path / "run.txt"
+        result = run_fla(["trace-render", str(trace), "-o", str(output)])
+        assert result.returncode == EXIT_SUCCESS
+        assert output.read_text() == expected.stdout
+
+    def test_invalid_trace(self, tmp_path):
+        trace = tmp_path / "broken.trace"
+        trace.write_bytes(b"FLAT\x01R")
+        result = run_fla(["trace-render", str(trace)])
+        assert result.returncode == EXIT_FAILURE
+        assert result.stderr == "Invalid trace: " + str(trace) + "\n"
+
+    def test_batch(self, tmp_path):
+        machine = os.path.join(ROOT_DIR, "pda/anbn.pda")
+        result = run_fla(
+            ["-b", "--trace", str(tmp_path / "run.trace"), machine],
+            input="ab\n",
+        )
+        assert result.returncode == EXIT_FAILURE
+        assert result.stderr == HELP_INFO
+
+
+class TestTraceFilter:
+    SEPARATOR = "---------------------------------------------\n"
+
+    # The configuration blocks of a -v run and their states
+    def blocks(self, flags, machine, input):
+        result = run_fla(["-v"] + flags + [os.path.join(ROOT_DIR, machine), input])
+        assert result.returncode == EXIT_SUCCESS
+        run = result.stdout.split("==================== RUN ====================\n")[1]
+        blocks = run.split("Result: ")[0].split(self.SEPARATOR)[:-1]
+        states = [block.splitlines()[1].split(": ")[1] for block in blocks]
+        return blocks, states, run.split("Result: ")[1]
+
+    @pytest.mark.parametrize(
+        "machine, input",
+        [
+            ("pda/anbn.pda", "aaabbb"),
+            ("pda/case.pda", "(()"),
+            ("tm/palindrome_detector_2tapes.tm", "1001001"),
+            ("tm/unary_double.tm", "111"),
+        ],
+    )
+    def test_filters(self, machine, input):
+        blocks, states, result = self.blocks([], machine, input)
+        steps = range(len(blocks))
+
+        for first, last, every in [(3, 20, 4), (5, 0, 3), (2, 2, 1), (100, 0, 1)]:
+            flags = ["--show-from", str(first), "--show-to", str(last)]
+            flags += ["--show-every", str(every)]
+            expected = [
+                blocks[i]
+                for i in steps
+                if i >= first and (last == 0 or i <= last) and (i - first) % every == 0
+            ]
+            assert self.blocks(flags, machine, input)[0] == expected
+
+        entered = sorted(set(states))[:2]
+        expected = [
+            blocks[i]
+            for i in steps
+            if states[i] in entered and (i == 0 or states[i - 1] != states[i])
+        ]
+        flags = ["--show-states", ",".join(entered)]
+        assert self.blocks(flags, machine, input)[0] == expected
+
+        # the ring keeps the last configurations, the other filters pick from them
+        for size in [1, 4, len(blocks) + 2]:
+            assert self.blocks(["--show-last", str(size)], machine, input) == (
+                blocks[-size:],
+                states[-size:],
+                result,
+            )
+            expected = [blocks[i] for i in steps[-size:] if i % 2 == 0]
+            flags = ["--show-last", str(size), "--show-every", "2"]
+            assert self.blocks(flags, machine, input)[0] == expected
+
+    def test_ring_at_limit(self):
+        flags = ["--max-steps", "50", "--show-last", "2"]
+        blocks, _, result = self.blocks(flags, "tm/loop.tm", "a")
+        assert [block.splitlines()[0] for block in blocks] == ["Step   : 49", "Step   : 50"]
+        assert result == "a\n==================== END ====================\n"
+
+
+class TestStats:
+    @pytest.mark.parametrize(
+        "machine, input, output",
+        [
+            ("pda/case.pda", "(()())", "true"),
+            ("tm/palindrome_detector_2tapes.tm", "1001001", "true"),
+            ("tm/case1.tm", "aabb", "cccc"),
+        ],
+    )
+    def test_json(self, machine, input, output):
+        result = run_fla(["--profile", "--stats", "json", os.path.join(ROOT_DIR, machine), input])
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stdout == output + "\n"
+
+        stats = json.loads(result.stderr)
+        assert sum(rule["fires"] for rule in stats["rules"]) == stats["steps"]
+        assert sum(state["visits"] for state in stats["states"]) == stats["steps"] + 1
+        fires = [rule["fires"] for rule in stats["rules"]]
+        assert fires == sorted(fires, reverse=True)
+        if machine.endswith(".pda"):
+            assert stats["max_stack"] == 3
+        else:
+            assert len(stats["tape_cells"]) > 0
+
+    def test_text(self):
+        result = run_fla(["--profile", PDA_DIR + "case.pda", "(()())"])
+        assert result.returncode == EXIT_SUCCESS
+        lines = result.stderr.splitlines()
+        assert lines[0] == "steps: 6"
+        assert "max stack: 3" in lines
+        assert "  2\tq1 ( 0 10 q1" in lines
+        assert "  5\tq1" in lines
+
+        # without --profile only the totals are printed
+        result = run_fla(["--stats", "text", TM_DIR + "case1.tm", "aabb"])
+        lines = result.stderr.splitlines()
+        assert lines[0] == "steps: 25"
+        assert lines[-3:] == ["tape 0 cells: 9", "tape 1 cells: 5", "tape 2 cells: 4"]
+
+    @pytest.mark.parametrize("search", ["bfs", "dfs", "iddfs"])
+    def test_nondeterministic(self, search):
+        flags = ["-n", "--search", search, "--profile", "--stats", "json"]
+        result = run_fla(flags + [TM_DIR + "substring.tm", "ababb"])
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stdout == "aba\n"
+        stats = json.loads(result.stderr)
+        assert stats["tape_cells"][0] >= 5
+        assert sum(state["visits"] for state in stats["states"]) > 0
+        assert sum(rule["fires"] for rule in stats["rules"]) > 0
+
+        result = run_fla(["-n", "--stats", "json", PDA_DIR + "palindrome.pda", "abba"])
+        assert result.returncode == EXIT_SUCCESS
+        stats = json.loads(result.stderr)
+        assert stats["max_stack"] >= 3
+        assert stats["rules"] == []
+
+    @pytest.mark.parametrize(
+        "flags",
+        [["--stats", "xml"], ["--stats"], ["-b", "--stats", "text"], ["-b", "--profile"]],
+    )
+    def test_invalid(self, flags):
+        result = run_fla(flags + [PDA_DIR + "case.pda", "()"])
+        assert result.returncode == EXIT_FAILURE
+        assert result.stderr.endswith(HELP_INFO)
@@ -1,10 +1,9 @@
-import subprocess
 import os
 import pytest
 
-from util import EXIT_SUCCESS, EXIT_FAILURE, EXEC_PATH
+from util import EXIT_SUCCESS, EXIT_FAILURE, ROOT_DIR, run_fla
 
-PDA_DIR = os.path.join(os.path.dirname(__file__), "../pda/")
+PDA_DIR = os.path.join(ROOT_DIR, "pda/")
 
 PDA_ACCEPT_OUTPUT = "true\n"
 PDA_REJECT_OUTPUT = "false\n"
@@ -29,7 +28,7 @@ class TestPDA:
         ],
     )
     def test_anbn(self, args, returncode, stdout, stderr):
-        result = subprocess.run([EXEC_PATH] + args, capture_output=True, text=True)
+        result = run_fla(args)
         assert result.returncode == returncode
         assert result.stdout == stdout
         assert result.stderr == stderr
@@ -50,7 +49,78 @@ class TestPDA:
         ],
     )
     def test_case(self, args, returncode, stdout, stderr):
-        result = subprocess.run([EXEC_PATH] + args, capture_output=True, text=True)
+        result = run_fla(args)
         assert result.returncode == returncode
         assert result.stdout == stdout
         assert result.stderr == stderr
+
+    @pytest.mark.parametrize(
+        "args, returncode, stdout, stderr",
+        [
+            # accept examples
+            (["-n", PDA_DIR + "palindrome.pda", ""], EXIT_SUCCESS, PDA_ACCEPT_OUTPUT, ""),
+            (["-n", PDA_DIR + "palindrome.pda", "abba"], EXIT_SUCCESS, PDA_ACCEPT_OUTPUT, ""),
+            (["-n", PDA_DIR + "palindrome.pda", "babbab"], EXIT_SUCCESS, PDA_ACCEPT_OUTPUT, ""),
+            # reject examples
+            (["-n", PDA_DIR + "palindrome.pda", "aba"], EXIT_SUCCESS, PDA_REJECT_OUTPUT, ""),
+            (["-n", PDA_DIR + "palindrome.pda", "abab"], EXIT_SUCCESS, PDA_REJECT_OUTPUT, ""),
+            # configuration budget
+            (
+                ["-n", "--max-configs", "5", PDA_DIR + "palindrome.pda", "abbaabba"],
+                EXIT_SUCCESS,
+                "limit\n",
+                "",
+            ),
+            # deterministic machines may not overlap
+            ([PDA_DIR + "palindrome.pda", "abba"], EXIT_FAILURE, "", "syntax error\n"),
+            # deterministic machines run the same
+            (["-n", PDA_DIR + "anbn.pda", "aabb"], EXIT_SUCCESS, PDA_ACCEPT_OUTPUT, ""),
+            (["-n", PDA_DIR + "anbn.pda", "aab"], EXIT_SUCCESS, PDA_REJECT_OUTPUT, ""),
+        ],
+    )
+    def test_nondeterministic(self, args, returncode, stdout, stderr):
+        result = run_fla(args)
+        assert result.returncode == returncode
+        assert result.stdout == stdout
+        assert result.stderr == stderr
+
+    @pytest.mark.parametrize(
+        "content, returncode, stdout, stderr",
+        [
+            ("aaabbb\n", EXIT_SUCCESS, PDA_ACCEPT_OUTPUT, ""),
+            ("aaabbb", EXIT_SUCCESS, PDA_ACCEPT_OUTPUT, ""),
+            ("aab\r\n", EXIT_SUCCESS, PDA_REJECT_OUTPUT, ""),
+            ("", EXIT_SUCCESS, PDA_REJECT_OUTPUT, ""),
+            # the rest of the input is checked after the machine halts
+            ("abbc", EXIT_FAILURE, "", PDA_INPUT_ERROR),
+        ],
+    )
+    def test_input_file(self, tmp_path, content, returncode, stdout, stderr):
+        path = tmp_path / "input.txt"
+        path.write_bytes(content.encode())
+        args = [PDA_DIR + "anbn.pda"]
+
+        result = run_fla(args + ["-i", str(path)])
+        assert result.returncode == returncode
+        assert result.stdout == stdout
+        assert result.stderr == stderr
+
+        result = run_fla(args + ["--input-file", "-"], input=content)
+        assert result.returncode == returncode
+        assert result.stdout == stdout
+        assert result.stderr == stderr
+
+    def test_long_input_file(self, tmp_path):
+        # longer than one chunk of the standard input
+        content = "a" * 100000 + "b" * 100000 + "\n"
+        path = tmp_path / "input.txt"
+        path.write_text(content)
+        args = [PDA_DIR + "anbn.pda", "-i"]
+
+        result = run_fla(args + [str(path)])
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stdout == PDA_ACCEPT_OUTPUT
+
+        result = run_fla(args + ["-"], input=content)
+        assert result.returncode == EXIT_SUCCESS
+        assert result.stdout == PDA_ACCEPT_OUTPUT
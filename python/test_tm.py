@@ -1,10 +1,9 @@
-import subprocess
 import os
 import pytest
 
-from util import EXIT_SUCCESS, EXIT_FAILURE, EXEC_PATH
+from util import EXIT_SUCCESS, EXIT_FAILURE, ROOT_DIR, run_fla, HELP_INFO
 
-TM_DIR = os.path.join(os.path.dirname(__file__), "../tm/")
+TM_DIR = os.path.join(ROOT_DIR, "tm/")
 
 TM_INPUT_ERROR = "illegal input\n"
 
@@ -61,7 +60,7 @@ class TestPDA:
         ],
     )
     def test_palindrome(self, args, returncode, stdout, stderr):
-        result = subprocess.run([EXEC_PATH] + args, capture_output=True, text=True)
+        result = run_fla(args)
         assert result.returncode == returncode
         assert result.stdout == stdout
         assert result.stderr == stderr
@@ -117,7 +116,80 @@ class TestPDA:
         ],
     )
     def test_case1(self, args, returncode, stdout, stderr):
-        result = subprocess.run([EXEC_PATH] + args, capture_output=True, text=True)
+        result = run_fla(args)
+        assert result.returncode == returncode
+        assert result.stdout == stdout
+        assert result.stderr == stderr
+
+    @pytest.mark.parametrize(
+        "args, returncode, stdout, stderr",
+        [
+            ([TM_DIR + "wildcard.tm", "abab"], EXIT_SUCCESS, "abac\n", ""),
+            ([TM_DIR + "wildcard.tm", "b"], EXIT_SUCCESS, "c\n", ""),
+            ([TM_DIR + "wildcard.tm", ""], EXIT_SUCCESS, "\n", ""),
+            (["--table-limit", "0", TM_DIR + "wildcard.tm", "abab"], EXIT_SUCCESS, "abac\n", ""),
+            (["--macro", "2", TM_DIR + "wildcard.tm", "abab"], EXIT_SUCCESS, "abac\n", ""),
+            (["--macro", "8", TM_DIR + "unary_double.tm", "111"], EXIT_SUCCESS, "111111\n", ""),
+            (["--tape", "rle", TM_DIR + "wildcard.tm", "abab"], EXIT_SUCCESS, "abac\n", ""),
+        ],
+    )
+    def test_wildcard(self, args, returncode, stdout, stderr):
+        result = run_fla(args)
+        assert result.returncode == returncode
+        assert result.stdout == stdout
+        assert result.stderr == stderr
+
+    @pytest.mark.parametrize(
+        "args, returncode, stdout, stderr",
+        [
+            # accept examples, every strategy finds the same branch
+            (["-n", TM_DIR + "substring.tm", "ababb"], EXIT_SUCCESS, "aba\n", ""),
+            (["-n", "--search", "dfs", TM_DIR + "substring.tm", "ababb"], EXIT_SUCCESS, "aba\n", ""),
+            (["-n", "--search", "iddfs", TM_DIR + "substring.tm", "ababb"], EXIT_SUCCESS, "aba\n", ""),
+            (["-n", "--search", "bfs", TM_DIR + "substring.tm", "bbabab"], EXIT_SUCCESS, "bbaba\n", ""),
+            # reject examples keep the tape of the first halted branch
+            (["-n", TM_DIR + "substring.tm", "abba"], EXIT_SUCCESS, "abba\n", ""),
+            (["-n", "--search", "iddfs", TM_DIR + "substring.tm", ""], EXIT_SUCCESS, "\n", ""),
+            # configuration budget
+            (
+                ["-n", "--max-configs", "3", TM_DIR + "substring.tm", "bbbbbaba"],
+                EXIT_SUCCESS,
+                "limit\n",
+                "",
+            ),
+            # deterministic machines may not overlap
+            ([TM_DIR + "substring.tm", "aba"], EXIT_FAILURE, "", "syntax error\n"),
+            (
+                ["--check-overlaps", TM_DIR + "substring.tm", "aba"],
+                EXIT_FAILURE,
+                "",
+                "overlap: 'q0 a a r q1' is covered by 'q0 * * r q0'\nsyntax error\n",
+            ),
+            (
+                ["-n", "--check-overlaps", TM_DIR + "substring.tm", "aba"],
+                EXIT_SUCCESS,
+                "aba\n",
+                "overlap: 'q0 a a r q1' overlaps 'q0 * * r q0'\n",
+            ),
+            (["--check-overlaps", TM_DIR + "wildcard.tm", "abab"], EXIT_SUCCESS, "abac\n", ""),
+            # deterministic machines run the same
+            (["-n", TM_DIR + "wildcard.tm", "abab"], EXIT_SUCCESS, "abac\n", ""),
+            (
+                ["--search", "random", TM_DIR + "substring.tm", "aba"],
+                EXIT_FAILURE,
+                "",
+                "Invalid value for option: --search\n" + HELP_INFO,
+            ),
+            (
+                ["--tape", "tree", TM_DIR + "wildcard.tm", "aba"],
+                EXIT_FAILURE,
+                "",
+                "Invalid value for option: --tape\n" + HELP_INFO,
+            ),
+        ],
+    )
+    def test_nondeterministic(self, args, returncode, stdout, stderr):
+        result = run_fla(args)
         assert result.returncode == returncode
         assert result.stdout == stdout
         assert result.stderr == stderr
@@ -1,12 +1,46 @@
 import os
+import subprocess
 
-EXEC_PATH = os.path.join(os.path.dirname(__file__), "../bin/fla")
+ROOT_DIR = os.path.join(os.path.dirname(__file__), "..")
+EXEC_PATH = os.path.join(ROOT_DIR, "bin/fla")
 
 HELP_INFO = (
     "Usage:\tfla [-h|--help]\n"
     + "      \tfla [-v|--verbose] <pda> <input>\n"
     + "      \tfla [-v|--verbose] <tm> <input>\n"
+    + "      \tfla [-v|--verbose] -b|--batch [-j|--jobs <n>] <pda|tm> [<inputs>]\n"
+    + "      \tfla [-v|--verbose] <pda> -i|--input-file <file|->\n"
+    + "      \tfla compile <pda|tm> [-o|--output <image>]\n"
+    + "      \tfla codegen <tm> [-o|--output <source>]\n"
+    + "      \tfla trace-render <trace> [-o|--output <file>]\n"
+    + "Options:\n"
+    + "      \t-n|--nondeterministic\tfollow every applicable transition\n"
+    + "      \t--max-configs <n>\tconfigurations a non-deterministic run may visit, "
+    + "0 for no limit\n"
+    + "      \t--search <bfs|dfs|iddfs>\tsearch order of a non-deterministic tm\n"
+    + "      \t--max-steps <n>\tsteps a run may take, 0 for no limit\n"
+    + "      \t--max-cells <n>\ttape or stack cells a run may use, 0 for no limit\n"
+    + "      \t--timeout <ms>\twall-clock time a run may take, 0 for no limit\n"
+    + "      \t--detect-loops\tstop a run that repeats a configuration\n"
+    + "      \t--table-limit <bytes>\tmemory for each compiled tm transition table, 0 to disable them\n"
+    + "      \t--tape <flat|rle>\ttape storage of a deterministic tm\n"
+    + "      \t--macro <width>\tcache sweeps over blocks of a single-tape tm, 0 to disable it\n"
+    + "      \t--check-overlaps\treport the rules of a tm that overlap earlier ones\n"
+    + "      \t--trace <file>\trecord deterministic runs for fla trace-render\n"
+    + "      \t--show-from <step>\tfirst step -v prints\n"
+    + "      \t--show-to <step>\tlast step -v prints, 0 for no limit\n"
+    + "      \t--show-every <k>\tprint every k-th step with -v\n"
+    + "      \t--show-states <q1,q2,...>\tprint steps entering these states with -v\n"
+    + "      \t--show-last <n>\tprint the last n steps with -v when the run halts\n"
+    + "      \t--stats <text|json>\tprint the steps, times and cells of the run to stderr\n"
+    + "      \t--profile\tadd how often each rule fired and each state was met, "
+    "counted over the explored branches with -n\n"
 )
 
 EXIT_SUCCESS = 0
 EXIT_FAILURE = 1
+
+
+def run_fla(args, **kwargs):
+    """Runs fla with `args`, its output captured as text"""
+    return subprocess.run([EXEC_PATH] + args, capture_output=True, text=True, **kwargs)
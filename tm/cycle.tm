@@ -0,0 +1,22 @@
+; This tm program bounces between the first two cells forever when the input starts with 'a'
+; It is used to exercise --detect-loops
+
+#Q = {q0,q1,halt}
+
+#S = {a,b}
+
+#G = {a,b,_}
+
+#q0 = q0
+
+#B = _
+
+#F = {halt}
+
+#N = 1
+
+q0 a a r q1
+q0 b b * halt
+
+q1 * * l q0
+q1 _ _ l q0
@@ -0,0 +1,19 @@
+; This tm program walks right until it reads a 'b', so it never halts on inputs without one
+; It is used to exercise the --max-steps, --max-cells and --timeout limits
+
+#Q = {q0,halt}
+
+#S = {a,b}
+
+#G = {a,b,_}
+
+#q0 = q0
+
+#B = _
+
+#F = {halt}
+
+#N = 1
+
+q0 a a r q0
+q0 _ _ r q0
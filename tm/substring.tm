@@ -0,0 +1,27 @@
+; This tm program accepts the inputs that contain "aba" and erases everything after it
+; The start of "aba" has to be guessed, so it must be run with -n|--nondeterministic
+
+#Q = {q0,q1,q2,erase,accept}
+
+#S = {a,b}
+
+#G = {a,b,_}
+
+#q0 = q0
+
+#B = _
+
+#F = {accept}
+
+#N = 1
+
+; skip a symbol, or guess that "aba" starts here
+q0 * * r q0
+q0 a a r q1
+
+q1 b b r q2
+
+q2 a a r erase
+
+erase * _ r erase
+erase _ _ * accept
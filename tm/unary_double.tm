@@ -0,0 +1,37 @@
+; This tm program doubles a unary number: 1^n becomes 1^2n
+; Each 1 is marked and answered by a y at the right end, so the head sweeps over the whole tape
+; n times. It is used to exercise macro steps.
+
+#Q = {mark,append,back,end,convert,halt}
+
+#S = {1}
+
+#G = {1,x,y,_}
+
+#q0 = mark
+
+#B = _
+
+#F = {halt}
+
+#N = 1
+
+mark x x r mark
+mark 1 x r append
+mark y y r end
+mark _ _ l convert
+
+append 1 1 r append
+append y y r append
+append _ y l back
+
+back 1 1 l back
+back y y l back
+back x x r mark
+
+end y y r end
+end _ _ l convert
+
+convert x 1 l convert
+convert y 1 l convert
+convert _ _ r halt
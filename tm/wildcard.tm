@@ -0,0 +1,21 @@
+; This tm program replaces the last symbol of the input with 'c'
+; It exercises wildcard transitions, which never match the blank symbol
+
+#Q = {q0,q1,halt}
+
+#S = {a,b}
+
+#G = {a,b,c,_}
+
+#q0 = q0
+
+#B = _
+
+#F = {halt}
+
+#N = 1
+
+q0 * * r q0
+q0 _ _ l q1
+
+q1 * c * halt